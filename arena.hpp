@@ -0,0 +1,134 @@
+/* Arena de memoria: reserva un bloque una sola vez y reparte trozos alineados a 64 bytes (línea de caché)
+   avanzando un puntero. No hay free por trozo; arena_reset() libera todo de golpe (p. ej. al empezar cada
+   iteración), así los buffers temporales no vuelven a pasar por malloc ni se pierden */
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+/* Librerias */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+/* CONSTANTES */
+const size_t ARENA_ALIGN = 64;              // Alineación de cada trozo (línea de caché, vectores AVX-512)
+const size_t ARENA_HUGE_PAGE = 2 << 20;     // Tamaño de una página enorme (transparent huge pages)
+
+/* ESTRUCTURAS */
+/* Estructura arena */
+struct arena {
+    char *base;         // Inicio del bloque (alineado a ARENA_HUGE_PAGE)
+    size_t capacity;    // Bytes disponibles
+    size_t used;        // Bytes repartidos desde el último arena_reset
+    size_t peak;        // Máximo de used
+    void *mapping;      // Región reservada con mmap (para munmap)
+    size_t mapping_size;
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+inline size_t arena_round(size_t bytes);
+inline bool arena_init(arena *memory, size_t capacity, bool huge_pages = true);
+inline void *arena_alloc(arena *memory, size_t bytes);
+template <class T> T *arena_array(arena *memory, size_t n);
+inline void arena_reset(arena *memory);
+inline void arena_free(arena *memory);
+inline double peak_rss_mib();
+
+/* FUNCIONES */
+/* Bytes que ocupa un trozo de bytes en la arena (para calcular la capacidad necesaria) */
+inline size_t arena_round(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+/* Reserva el bloque de la arena. Las páginas solo ocupan memoria física al usarse. Con huge_pages se pide al
+   kernel que use páginas de 2 MiB (menos fallos de TLB en las columnas grandes); si no puede, se ignora */
+inline bool arena_init(arena *memory, size_t capacity, bool huge_pages)
+{
+    memory->capacity = arena_round(capacity);
+    memory->used = 0;
+    memory->peak = 0;
+    memory->mapping_size = memory->capacity + ARENA_HUGE_PAGE;
+    memory->mapping = mmap(NULL, memory->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory->mapping == MAP_FAILED)
+    {
+        memory->mapping = NULL;
+        memory->base = NULL;
+        memory->capacity = 0;
+        return false;
+    }
+    // Inicio alineado a página enorme para que el kernel pueda usarlas desde el primer byte
+    uintptr_t start = ((uintptr_t)memory->mapping + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1);
+    memory->base = (char*)start;
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && memory->capacity >= ARENA_HUGE_PAGE)
+    {
+        madvise(memory->base, memory->capacity, MADV_HUGEPAGE);
+    }
+#else
+    (void)huge_pages;
+#endif
+    return true;
+}
+
+/* Trozo de bytes alineado a ARENA_ALIGN, o NULL si no cabe en la arena */
+inline void *arena_alloc(arena *memory, size_t bytes)
+{
+    size_t size = arena_round(bytes);
+    if (memory->base == NULL || memory->used + size > memory->capacity)
+    {
+        return NULL;
+    }
+    void *chunk = memory->base + memory->used;
+    memory->used += size;
+    if (memory->used > memory->peak)
+    {
+        memory->peak = memory->used;
+    }
+    return chunk;
+}
+
+/* Vector de n elementos de tipo T en la arena (sin inicializar). Si la arena no está reservada o se ha quedado
+   corta es un error de dimensionado: se avisa y se aborta en vez de devolver NULL */
+template <class T>
+T *arena_array(arena *memory, size_t n)
+{
+    T *chunk = (T*)arena_alloc(memory, sizeof(T)*n);
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Arena sin espacio: se piden %zu bytes con %zu de %zu usados\n", arena_round(sizeof(T)*n), memory->used, memory->capacity);
+        abort();
+    }
+    return chunk;
+}
+
+/* Libera todos los trozos (la memoria se reutiliza en los siguientes arena_alloc) */
+inline void arena_reset(arena *memory)
+{
+    memory->used = 0;
+}
+
+/* Devuelve el bloque al sistema */
+inline void arena_free(arena *memory)
+{
+    if (memory->mapping != NULL)
+    {
+        munmap(memory->mapping, memory->mapping_size);
+    }
+    memory->mapping = NULL;
+    memory->base = NULL;
+    memory->capacity = 0;
+    memory->used = 0;
+}
+
+/* Pico de memoria residente del proceso en MiB */
+inline double peak_rss_mib()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // ru_maxrss en KiB en Linux
+}
+
+#endif
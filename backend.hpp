@@ -0,0 +1,322 @@
+/* Backends de los bucles paralelos sobre objetos: OpenMP, algoritmos paralelos de la biblioteca estándar
+   (std::execution, con TBB por debajo en libstdc++) o un pool de tareas externo. Así la simulación se puede
+   ejecutar dentro del pool de hilos de otra aplicación en vez de crear los hilos de OpenMP */
+#ifndef BACKEND_HPP
+#define BACKEND_HPP
+
+/* Librerias */
+#include <algorithm>
+#include <execution>
+#include <iterator>
+#include <numeric>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <omp.h>
+
+/* CONSTANTES */
+const long POOL_TASKS_PER_WORKER = 8;   // Tareas por hilo del pool en cada bucle (reparto de la carga)
+
+/* ESTRUCTURAS */
+/* Backends disponibles */
+enum backend_type {
+    OPENMP,     // Pragmas de OpenMP
+    STD_PAR,    // std::for_each con std::execution::par_unseq (par en los bucles de pares, que fusionan objetos)
+    TASK_POOL   // Pool de tareas externo (task_pool)
+};
+
+/* Estructura pool de tareas externo. run debe ejecutar task(data, k) para k en [0, tasks) con sus hilos y volver
+   cuando hayan terminado todas. Cualquier pool de la aplicación se puede adaptar a esta interfaz */
+struct task_pool {
+    void *context;
+    int workers;    // Hilos del pool (para decidir en cuántas tareas se divide cada bucle)
+    void (*run)(void *context, long tasks, void (*task)(void *data, long k), void *data);
+};
+
+/* Estructura thread_pool: pool de hilos propio que implementa la interfaz task_pool.
+   Los hilos esperan a cada bucle y reparten sus tareas con un contador atómico; el hilo que llama también trabaja */
+struct thread_pool {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    long generation = 0;            // Se incrementa con cada bucle
+    bool stop = false;
+    int busy = 0;                   // Hilos que aún no han terminado el bucle actual
+    long tasks = 0;
+    std::atomic<long> next{0};      // Siguiente tarea por repartir
+    void (*task)(void *data, long k) = NULL;
+    void *data = NULL;
+};
+
+/* Iterador de índices para los algoritmos paralelos (std::views::iota no cumple los requisitos de iterador
+   de acceso aleatorio de la biblioteca anterior a C++20 que piden las políticas de ejecución) */
+struct index_iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = long;
+    using difference_type = long;
+    using pointer = const long *;
+    using reference = long;
+    long value;
+
+    long operator*() const { return value; }
+    long operator[](long k) const { return value + k; }
+    index_iterator &operator++() { value++; return *this; }
+    index_iterator operator++(int) { index_iterator old = *this; value++; return old; }
+    index_iterator &operator--() { value--; return *this; }
+    index_iterator operator--(int) { index_iterator old = *this; value--; return old; }
+    index_iterator &operator+=(long k) { value += k; return *this; }
+    index_iterator &operator-=(long k) { value -= k; return *this; }
+    index_iterator operator+(long k) const { return {value + k}; }
+    index_iterator operator-(long k) const { return {value - k}; }
+    friend index_iterator operator+(long k, index_iterator it) { return {it.value + k}; }
+    long operator-(index_iterator other) const { return value - other.value; }
+    bool operator==(index_iterator other) const { return value == other.value; }
+    bool operator!=(index_iterator other) const { return value != other.value; }
+    bool operator<(index_iterator other) const { return value < other.value; }
+    bool operator>(index_iterator other) const { return value > other.value; }
+    bool operator<=(index_iterator other) const { return value <= other.value; }
+    bool operator>=(index_iterator other) const { return value >= other.value; }
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+inline const char *backend_name(backend_type backend);
+inline void thread_pool_worker(thread_pool *pool);
+inline void thread_pool_init(thread_pool *pool, int workers);
+inline void thread_pool_run(void *context, long tasks, void (*task)(void *data, long k), void *data);
+inline void thread_pool_free(thread_pool *pool);
+inline task_pool make_task_pool(thread_pool *pool);
+template <class Body> void parallel_bodies(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body);
+template <class Body> void parallel_pairs(backend_type backend, task_pool *pool, int n, Body body);
+template <class Body> double parallel_sum(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body);
+template <class Body> void pool_for(task_pool *pool, int n, int grain, Body body);
+template <class Value> Value pairwise_sum(const Value *values, long n);
+template <class Body> double reproducible_sum(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body);
+
+/* FUNCIONES */
+/* Nombre del backend (opción --backend y tablas de bench-kernels) */
+inline const char *backend_name(backend_type backend)
+{
+    return backend == OPENMP ? "openmp" : backend == STD_PAR ? "std" : "pool";
+}
+
+/* Hilo del pool: espera a que haya un bucle nuevo y ejecuta tareas hasta que no quedan */
+inline void thread_pool_worker(thread_pool *pool)
+{
+    long seen = 0;
+    while (true)
+    {
+        std::unique_lock<std::mutex> guard(pool->lock);
+        pool->wake.wait(guard, [pool, seen] { return pool->stop || pool->generation != seen; });
+        if (pool->stop)
+        {
+            return;
+        }
+        seen = pool->generation;
+        guard.unlock();
+
+        for (long k = pool->next++; k < pool->tasks; k = pool->next++)
+        {
+            pool->task(pool->data, k);
+        }
+
+        guard.lock();
+        if (--pool->busy == 0)
+        {
+            pool->finished.notify_one();
+        }
+    }
+}
+
+/* Arranca workers - 1 hilos (el hilo que llama a run es el último) */
+inline void thread_pool_init(thread_pool *pool, int workers)
+{
+    for (int t = 1; t < workers; t++)
+    {
+        pool->threads.emplace_back(thread_pool_worker, pool);
+    }
+}
+
+/* Implementación de task_pool::run para thread_pool */
+inline void thread_pool_run(void *context, long tasks, void (*task)(void *data, long k), void *data)
+{
+    thread_pool *pool = (thread_pool*)context;
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->tasks = tasks;
+    pool->task = task;
+    pool->data = data;
+    pool->next = 0;
+    pool->busy = pool->threads.size();
+    pool->generation++;
+    guard.unlock();
+    pool->wake.notify_all();
+
+    for (long k = pool->next++; k < tasks; k = pool->next++)
+    {
+        task(data, k);
+    }
+
+    guard.lock();
+    pool->finished.wait(guard, [pool] { return pool->busy == 0; });
+}
+
+/* Detiene los hilos del pool */
+inline void thread_pool_free(thread_pool *pool)
+{
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+    for (std::thread &thread : pool->threads)
+    {
+        thread.join();
+    }
+    pool->threads.clear();
+}
+
+/* Interfaz task_pool del pool propio */
+inline task_pool make_task_pool(thread_pool *pool)
+{
+    return {pool, (int)pool->threads.size() + 1, thread_pool_run};
+}
+
+/* Bucle sobre los índices [0, n) en tareas de tamaño fijo (al menos grain índices) del pool externo */
+template <class Body>
+void pool_for(task_pool *pool, int n, int grain, Body body)
+{
+    struct chunks {
+        Body *body;
+        long n;
+        long size;
+    };
+    long tasks = std::min(((long)n + grain - 1) / grain, (long)pool->workers * POOL_TASKS_PER_WORKER);
+    if (tasks <= 0)
+    {
+        return;
+    }
+    chunks work = {&body, n, (n + tasks - 1) / tasks};
+    pool->run(pool->context, (n + work.size - 1) / work.size, [](void *data, long k) {
+        chunks *work = (chunks*)data;
+        for (long i = k * work->size; i < std::min((k + 1) * work->size, work->n); i++)
+        {
+            (*work->body)((int)i);
+        }
+    }, &work);
+}
+
+/* Bucle sobre los objetos: body(i) solo modifica los datos del objeto i. grain es el reparto mínimo de OpenMP
+   y del pool (objetos por bloque); sin parallel se ejecuta en serie */
+template <class Body>
+void parallel_bodies(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body)
+{
+    if (!parallel)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            body(i);
+        }
+    }
+    else if (backend == STD_PAR)
+    {
+        std::for_each(std::execution::par_unseq, index_iterator{0}, index_iterator{n}, [&body](long i) { body((int)i); });
+    }
+    else if (backend == TASK_POOL)
+    {
+        pool_for(pool, n, grain, body);
+    }
+    else
+    {
+        #pragma omp parallel for schedule(dynamic, grain)
+        for (int i = 0; i < n; i++)
+        {
+            body(i);
+        }
+    }
+}
+
+/* Bucle sobre las filas i de los pares (i, j > i): la fila i puede modificar otros objetos al fusionarlos, así
+   que con std::execution se usa par (sin unseq, que no admite las escrituras concurrentes) */
+template <class Body>
+void parallel_pairs(backend_type backend, task_pool *pool, int n, Body body)
+{
+    if (backend == STD_PAR)
+    {
+        std::for_each(std::execution::par, index_iterator{0}, index_iterator{n}, [&body](long i) { body((int)i); });
+    }
+    else if (backend == TASK_POOL)
+    {
+        pool_for(pool, n, 1, body);
+    }
+    else
+    {
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++)
+        {
+            body(i);
+        }
+    }
+}
+
+/* Suma de body(i) sobre los objetos (p. ej. la energía potencial junto a las fuerzas) */
+template <class Body>
+double parallel_sum(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body)
+{
+    double sum = 0;
+    if (!parallel)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            sum += body(i);
+        }
+    }
+    else if (backend == STD_PAR)
+    {
+        sum = std::transform_reduce(std::execution::par_unseq, index_iterator{0}, index_iterator{n}, 0.0, std::plus<double>(), [&body](long i) { return body((int)i); });
+    }
+    else if (backend == TASK_POOL)
+    {
+        // Una suma parcial por objeto y la suma final en serie
+        std::vector<double> partial(n);
+        pool_for(pool, n, grain, [&partial, &body](int i) { partial[i] = body(i); });
+        for (int i = 0; i < n; i++)
+        {
+            sum += partial[i];
+        }
+    }
+    else
+    {
+        #pragma omp parallel for schedule(dynamic, grain) reduction(+:sum)
+        for (int i = 0; i < n; i++)
+        {
+            sum += body(i);
+        }
+    }
+    return sum;
+}
+
+/* Suma por mitades de values[0, n): el árbol de sumas solo depende de n */
+template <class Value>
+Value pairwise_sum(const Value *values, long n)
+{
+    if (n <= 1)
+    {
+        return n == 1 ? values[0] : Value();
+    }
+    long half = n / 2;
+    return pairwise_sum(values, half) + pairwise_sum(values + half, n - half);
+}
+
+/* Suma de body(i) sobre los objetos con el mismo resultado bit a bit para cualquier backend y número de hilos:
+   cada body(i) se guarda en su posición y se suman con pairwise_sum */
+template <class Body>
+double reproducible_sum(backend_type backend, task_pool *pool, int n, int grain, bool parallel, Body body)
+{
+    std::vector<double> partial(n);
+    parallel_bodies(backend, pool, n, grain, parallel, [&partial, &body](int i) { partial[i] = body(i); });
+    return pairwise_sum(partial.data(), n);
+}
+
+#endif
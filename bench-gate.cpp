@@ -0,0 +1,470 @@
+/* Librerias */
+#include <iostream>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <omp.h>
+
+using namespace std;
+
+/* CONSTANTES */
+const string BASELINE_DIR = "baselines";                 // Directorio de las líneas base (dentro del repositorio)
+const string BASELINE_FILE = "baselines/steptime.txt";   // Tiempos por paso de referencia
+const int DEFAULT_REPETITIONS = 7;                       // Ejecuciones por variante y tamaño
+const double DEFAULT_THRESHOLD = 0.25;                   // Empeoramiento máximo de la mediana (25%)
+const double ALPHA = 0.05;                               // Nivel de significación del test de Mann-Whitney
+const double REL_TOLERANCE = 1E-9;                       // Tolerancia relativa de final_config.txt
+const double ABS_TOLERANCE = 1E-3;                       // Tolerancia absoluta (precisión de impresión)
+
+/* ESTRUCTURAS */
+/* Estructura caso: variante y tamaño de problema a medir */
+struct gate_case {
+    string variant;
+    int num_objects;
+    int num_iterations;
+    int random_seed;
+    double size_enclosure;
+    double time_step;
+};
+
+/* Estructura baseline: caso con sus tiempos por paso de referencia */
+struct gate_baseline {
+    gate_case test;
+    vector<double> step_times;
+};
+
+/* Casos medidos. sim-aos-opti no se incluye porque abre una ventana de OpenCV */
+const vector<gate_case> CASES = {
+    {"sim-aos", 250, 100, 81, 100000, 0.1},
+    {"sim-aos", 1000, 20, 81, 100000, 0.1},
+    {"sim-soa", 250, 100, 81, 100000, 0.1},
+    {"sim-soa", 1000, 20, 81, 100000, 0.1},
+    {"sim-paos", 250, 100, 81, 100000, 0.1},
+    {"sim-paos", 1000, 20, 81, 100000, 0.1},
+    {"sim-psoa", 250, 100, 81, 100000, 0.1},
+    {"sim-psoa", 1000, 20, 81, 100000, 0.1},
+    {"sim-soa-opti", 100, 100, 81, 100000, 0.1}, // Copia los vectores en cada llamada: tamaños menores
+    {"sim-soa-opti", 200, 10, 81, 100000, 0.1},
+};
+
+/* Estructura comprobación de consistencia: dos órdenes que deben escribir en la salida estándar lo mismo byte a
+   byte. Se ejecutan en el directorio temporal con BIN apuntando al directorio de los binarios */
+struct gate_consistency {
+    string name;
+    string command;
+    string reference;
+};
+
+/* Comprobaciones de consistencia (solo con check). sim-ensemble ejecuta cada trabajo en un solo hilo, así que
+   debe dar lo mismo que sim-psoa --threads=1 con cada trabajo, también con las opciones que reparten por hilo */
+const string ENSEMBLE_JOBS = "printf '5 1000000 0.1 2000\\n7 100000 0.1 500\\n' > jobs.txt && ";
+const vector<gate_consistency> CONSISTENCY = {
+    {"sim-ensemble --morton=1 (4 threads)",
+     ENSEMBLE_JOBS + "OMP_NUM_THREADS=4 $BIN/sim-ensemble.o jobs.txt 5 ensemble.txt --morton=1 > /dev/null && cat ensemble.txt",
+     "echo '# job 0 5' && $BIN/sim-psoa.o 2000 5 5 1000000 0.1 --threads=1 --morton=1 > /dev/null && cat final_config.txt && "
+     "echo '# job 1 7' && $BIN/sim-psoa.o 500 5 7 100000 0.1 --threads=1 --morton=1 > /dev/null && cat final_config.txt"},
+    {"sim-ensemble --force=cutoff (4 threads)",
+     ENSEMBLE_JOBS + "OMP_NUM_THREADS=4 $BIN/sim-ensemble.o jobs.txt 5 ensemble.txt --force=cutoff > /dev/null && cat ensemble.txt",
+     "echo '# job 0 5' && $BIN/sim-psoa.o 2000 5 5 1000000 0.1 --threads=1 --force=cutoff > /dev/null && cat final_config.txt && "
+     "echo '# job 1 7' && $BIN/sim-psoa.o 500 5 7 100000 0.1 --threads=1 --force=cutoff > /dev/null && cat final_config.txt"},
+    {"sim-psoa --reproducible --output-every=3 (2 threads)",
+     "$BIN/sim-psoa.o 1000 20 5 30000 0.1 --reproducible --output-every=3 --threads=2 > /dev/null && rm -rf snapshots && cat final_config.txt",
+     "$BIN/sim-psoa.o 1000 20 5 30000 0.1 --reproducible --threads=1 > /dev/null && cat final_config.txt"},
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+string case_arguments(gate_case test);
+string reference_path(gate_case test);
+bool run_case(gate_case test, string work_dir, double *step_time);
+vector<gate_baseline> read_baselines(string path);
+bool write_baselines(string path, vector<gate_baseline> &baselines);
+double median(vector<double> values);
+double mann_whitney_p(vector<double> &baseline, vector<double> &current);
+bool compare_configs(string reference, string current, string *error);
+bool run_consistency(gate_consistency check, string work_dir, bool *same);
+
+/* MAIN */
+int main(int argc, char const *argv[])
+{
+    /* Comprobación inicial argumentos */
+    if (argc < 2 || argc > 4 || (string(argv[1]) != "record" && string(argv[1]) != "check" && string(argv[1]) != "update"))
+    {
+        cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./bench-gate <record|check|update> [repetitions] [threshold]\n";
+        return -1;
+    }
+
+    /* Comprobación de valores iniciales de argumentos */
+    if ((argc > 2 && (atoi(argv[2]) <= 0 || atof(argv[2]) != atoi(argv[2]))) || (argc > 3 && atof(argv[3]) <= 0.0))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
+    /* Almacenamiento de los argumentos en sus respectivas variables */
+    bool record = string(argv[1]) == "record";
+    bool update = string(argv[1]) == "update";   // check que además guarda los tiempos de los casos más rápidos
+    int repetitions = argc > 2 ? atoi(argv[2]) : DEFAULT_REPETITIONS; // Ejecuciones por caso
+    double threshold = argc > 3 ? atof(argv[3]) : DEFAULT_THRESHOLD;  // Empeoramiento relativo permitido
+
+    /* Directorio temporal donde se ejecutan las simulaciones (escriben init/final_config.txt) */
+    char work_template[] = "/tmp/bench-gate-XXXXXX";
+    if (mkdtemp(work_template) == NULL)
+    {
+        cerr << "No se pudo crear el directorio temporal\n";
+        return -3;
+    }
+    string work_dir = work_template;
+
+    vector<gate_baseline> baselines;
+    if (!record)
+    {
+        baselines = read_baselines(BASELINE_FILE);
+        if (baselines.empty())
+        {
+            cerr << "No hay líneas base en " << BASELINE_FILE << ", ejecuta primero ./bench-gate record\n";
+            return -3;
+        }
+    }
+
+    cout << left << setw(14) << "Variant" << right << setw(8) << "N" << setw(16) << "base (s/step)" << setw(16) << "new (s/step)"
+         << setw(9) << "ratio" << setw(10) << "p-value" << "  " << left << setw(10) << "config" << "result\n";
+
+    bool failed = false;
+    int improved = 0;
+    vector<gate_baseline> recorded;
+    for (gate_case test : CASES)
+    {
+        /* Ejecuciones repetidas del caso */
+        vector<double> step_times;
+        bool ok = true;
+        for (int rep = 0; rep < repetitions && ok; rep++)
+        {
+            double step_time;
+            ok = run_case(test, work_dir, &step_time);
+            step_times.push_back(step_time);
+        }
+        if (!ok)
+        {
+            cerr << "Fallo al ejecutar ./" << test.variant << ".o " << case_arguments(test) << "\n";
+            failed = true;
+            continue;
+        }
+        string final_config = work_dir + "/final_config.txt";
+
+        if (record)
+        {
+            /* Guardamos los tiempos y la configuración final de referencia */
+            recorded.push_back({test, step_times});
+            ifstream src(final_config, ios::binary);
+            ofstream dst(reference_path(test), ios::binary);
+            dst << src.rdbuf();
+            cout << left << setw(14) << test.variant << right << setw(8) << test.num_objects << setw(16) << "-"
+                 << scientific << setprecision(3) << setw(16) << median(step_times) << setw(9) << "-" << setw(10) << "-"
+                 << "  " << left << setw(10) << "saved" << "recorded\n";
+            continue;
+        }
+
+        /* Buscamos la línea base del mismo caso */
+        gate_baseline *baseline = NULL;
+        for (gate_baseline &candidate : baselines)
+        {
+            if (candidate.test.variant == test.variant && candidate.test.num_objects == test.num_objects &&
+                case_arguments(candidate.test) == case_arguments(test))
+            {
+                baseline = &candidate;
+            }
+        }
+        if (baseline == NULL)
+        {
+            cerr << "No hay línea base para " << test.variant << " N=" << test.num_objects << "\n";
+            failed = true;
+            continue;
+        }
+
+        /* Test de Mann-Whitney (unilateral: ¿es la versión nueva más lenta?) y umbral sobre las medianas */
+        double ratio = median(step_times) / median(baseline->step_times);
+        double p = mann_whitney_p(baseline->step_times, step_times);
+        bool regression = p < ALPHA && ratio > 1 + threshold;
+        // Con update, los casos significativamente más rápidos (mismo test en el otro sentido) pasan a ser la base
+        bool faster = mann_whitney_p(step_times, baseline->step_times) < ALPHA && ratio < 1;
+
+        /* La física no puede cambiar: final_config.txt dentro de la tolerancia de la referencia */
+        string error;
+        bool config_ok = compare_configs(reference_path(test), final_config, &error);
+
+        cout << left << setw(14) << test.variant << right << setw(8) << test.num_objects << scientific << setprecision(3)
+             << setw(16) << median(baseline->step_times) << setw(16) << median(step_times) << fixed << setprecision(3)
+             << setw(9) << ratio << setw(10) << p << "  " << left << setw(10) << (config_ok ? "ok" : "MISMATCH")
+             << (regression || !config_ok ? "FAIL" : (update && faster ? "pass (updated)" : "pass")) << "\n";
+        if (!config_ok)
+        {
+            cerr << "  " << error << "\n";
+        }
+        if (update && faster && config_ok)
+        {
+            baseline->step_times = step_times;
+            improved++;
+        }
+        failed = failed || regression || !config_ok;
+    }
+
+    /* Comprobaciones de consistencia: las dos órdenes deben dar la misma salida */
+    if (!record)
+    {
+        cout << "\n" << left << setw(56) << "Consistency check" << "result\n";
+    }
+    for (size_t k = 0; k < CONSISTENCY.size() && !record; k++)
+    {
+        bool same = false;
+        bool ok = run_consistency(CONSISTENCY[k], work_dir, &same);
+        cout << left << setw(56) << CONSISTENCY[k].name << (ok && same ? "pass" : (ok ? "FAIL (output differs)" : "FAIL (command failed)")) << "\n";
+        failed = failed || !ok || !same;
+    }
+
+    if (record && !write_baselines(BASELINE_FILE, recorded))
+    {
+        cerr << "No se pudo escribir " << BASELINE_FILE << "\n";
+        return -3;
+    }
+    // Las líneas base solo se actualizan si pasa todo el gate; las configuraciones de referencia no cambian
+    if (update && !failed && improved > 0 && !write_baselines(BASELINE_FILE, baselines))
+    {
+        cerr << "No se pudo escribir " << BASELINE_FILE << "\n";
+        return -3;
+    }
+
+    /* Limpiamos el directorio temporal */
+    unlink((work_dir + "/init_config.txt").c_str());
+    unlink((work_dir + "/final_config.txt").c_str());
+    unlink((work_dir + "/jobs.txt").c_str());
+    unlink((work_dir + "/ensemble.txt").c_str());
+    rmdir(work_dir.c_str());
+
+    if (failed)
+    {
+        cout << "Regression gate: FAIL\n";
+        return -4;
+    }
+    if (update)
+    {
+        cout << "Baselines updated in " << BASELINE_FILE << ": " << improved << " faster case(s)\n";
+    }
+    cout << (record ? "Baselines recorded in " + BASELINE_FILE : string("Regression gate: pass")) << "\n";
+}
+
+/* FUNCIONES */
+/* Argumentos de línea de comandos de un caso */
+string case_arguments(gate_case test)
+{
+    ostringstream args;
+    args << test.num_objects << " " << test.num_iterations << " " << test.random_seed << " " << test.size_enclosure << " " << test.time_step;
+    return args.str();
+}
+
+/* Fichero con la configuración final de referencia de un caso */
+string reference_path(gate_case test)
+{
+    return BASELINE_DIR + "/final_config-" + test.variant + "-" + to_string(test.num_objects) + ".txt";
+}
+
+/* Ejecuta una vez la variante en work_dir y devuelve el tiempo medio por iteración */
+bool run_case(gate_case test, string work_dir, double *step_time)
+{
+    char binary[PATH_MAX];
+    if (realpath(("./" + test.variant + ".o").c_str(), binary) == NULL)
+    {
+        return false;
+    }
+    string command = "cd " + work_dir + " && " + binary + " " + case_arguments(test) + " > /dev/null";
+
+    double start = omp_get_wtime();
+    int status = system(command.c_str());
+    double end = omp_get_wtime();
+
+    *step_time = (end - start) / test.num_iterations;
+    return status == 0;
+}
+
+/* Ejecuta las dos órdenes de una comprobación de consistencia en work_dir y compara sus salidas */
+bool run_consistency(gate_consistency check, string work_dir, bool *same)
+{
+    char bin_dir[PATH_MAX];
+    if (realpath(".", bin_dir) == NULL)
+    {
+        return false;
+    }
+    string outputs[2];
+    string commands[2] = {check.command, check.reference};
+    for (int k = 0; k < 2; k++)
+    {
+        string output_path = work_dir + "/consistency.txt";
+        string command = "cd " + work_dir + " && export BIN=" + bin_dir + " && (" + commands[k] + ") > consistency.txt 2> /dev/null";
+        int status = system(command.c_str());
+        ifstream file(output_path, ios::binary);
+        ostringstream content;
+        content << file.rdbuf();
+        outputs[k] = content.str();
+        unlink(output_path.c_str());
+        if (status != 0 || outputs[k].empty())
+        {
+            return false;
+        }
+    }
+    *same = outputs[0] == outputs[1];
+    return true;
+}
+
+/* Lee las líneas base: variante N iteraciones semilla recinto paso t_1 ... t_R */
+vector<gate_baseline> read_baselines(string path)
+{
+    vector<gate_baseline> baselines;
+    ifstream file(path);
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        istringstream fields(line);
+        gate_baseline baseline;
+        fields >> baseline.test.variant >> baseline.test.num_objects >> baseline.test.num_iterations >> baseline.test.random_seed
+               >> baseline.test.size_enclosure >> baseline.test.time_step;
+        double step_time;
+        while (fields >> step_time)
+        {
+            baseline.step_times.push_back(step_time);
+        }
+        if (!baseline.step_times.empty())
+        {
+            baselines.push_back(baseline);
+        }
+    }
+    return baselines;
+}
+
+/* Escribe las líneas base junto con la máquina en la que se midieron */
+bool write_baselines(string path, vector<gate_baseline> &baselines)
+{
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+
+    ofstream file(path);
+    file << "# Tiempos por iteración (s) medidos con ./bench-gate record/update en " << host << " (" << omp_get_num_procs() << " cpus)\n";
+    file << "# variant num_objects num_iterations random_seed size_enclosure time_step step_time_1 ... step_time_R\n";
+    for (gate_baseline &baseline : baselines)
+    {
+        file << baseline.test.variant << " " << case_arguments(baseline.test) << scientific << setprecision(6);
+        for (double step_time : baseline.step_times)
+        {
+            file << " " << step_time;
+        }
+        file << defaultfloat << "\n";
+    }
+    return file.good();
+}
+
+/* Mediana de una muestra */
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* p-valor unilateral del test de Mann-Whitney U (H1: current es mayor que baseline), aproximación normal con corrección de empates */
+double mann_whitney_p(vector<double> &baseline, vector<double> &current)
+{
+    double n1 = baseline.size();
+    double n2 = current.size();
+
+    /* Rangos de la muestra conjunta (rango medio en los empates) */
+    vector<pair<double, int>> all;
+    for (double value : baseline) all.push_back({value, 0});
+    for (double value : current) all.push_back({value, 1});
+    sort(all.begin(), all.end());
+
+    double rank_sum = 0;   // Suma de rangos de la muestra current
+    double tie_term = 0;   // Suma de (t^3 - t) de los grupos empatados
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) j++;
+        double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++)
+        {
+            if (all[k].second == 1) rank_sum += rank;
+        }
+        double t = j - i;
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    double u = rank_sum - n2 * (n2 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double n = n1 + n2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0)
+    {
+        return 1.0;
+    }
+    double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+/* Compara dos final_config.txt valor a valor con tolerancia relativa y absoluta */
+bool compare_configs(string reference, string current, string *error)
+{
+    ifstream file_ref(reference);
+    ifstream file_cur(current);
+    if (!file_ref.is_open() || !file_cur.is_open())
+    {
+        *error = "no se puede abrir " + (file_ref.is_open() ? current : reference);
+        return false;
+    }
+
+    string line_ref;
+    string line_cur;
+    int line = 0;
+    while (true)
+    {
+        bool more_ref = (bool)getline(file_ref, line_ref);
+        bool more_cur = (bool)getline(file_cur, line_cur);
+        line++;
+        if (!more_ref || !more_cur)
+        {
+            if (more_ref != more_cur)
+            {
+                *error = "distinto número de líneas (línea " + to_string(line) + ")";
+                return false;
+            }
+            return true;
+        }
+
+        istringstream values_ref(line_ref);
+        istringstream values_cur(line_cur);
+        double a;
+        double b;
+        while (values_ref >> a)
+        {
+            if (!(values_cur >> b) || std::fabs(a - b) > ABS_TOLERANCE + REL_TOLERANCE * std::fabs(a))
+            {
+                *error = "línea " + to_string(line) + " fuera de tolerancia: \"" + line_cur + "\" frente a \"" + line_ref + "\"";
+                return false;
+            }
+        }
+        if (values_cur >> b)
+        {
+            *error = "línea " + to_string(line) + " con más valores que la referencia";
+            return false;
+        }
+    }
+}
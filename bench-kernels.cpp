@@ -0,0 +1,791 @@
+/* Librerias */
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <iomanip>
+#include <unistd.h>
+#include <omp.h>
+#include "simulation.hpp"
+
+using namespace std;
+
+/* CONSTANTES */
+const double SIZE_ENCLOSURE = 100000;       // Tamaño del recinto de las pruebas
+const double MIN_TIME = 0.05;               // Tiempo mínimo de cada medida (s)
+const int NUM_REPS = 5;                     // Repeticiones por medida (se queda la mejor)
+const int RANDOM_SEED = 81;                 // Semilla de las pruebas
+const int BACKEND_OBJECTS = 4096;           // Objetos de la comparación de backends
+const int INTEGRATION_OBJECTS = 1 << 20;    // Objetos de la comparación de la integración (no caben en L3)
+const double TIME_STEP = 0.1;               // Incremento de tiempo de la integración
+
+/* ESTRUCTURAS */
+/* Estructura objeto AOS (igual que sim-aos-opti.cpp) */
+struct object_aos {
+    double pos_x;
+    double pos_y;
+    double pos_z;
+    double speed_x;
+    double speed_y;
+    double speed_z;
+    double mass;
+};
+
+/* Estructura objeto SOA (igual que sim-psoa.cpp) */
+struct object_soa {
+    double *pos_x;
+    double *pos_y;
+    double *pos_z;
+    double *speed_x;
+    double *speed_y;
+    double *speed_z;
+    double *mass;
+    bool *active;
+};
+
+/* Estructura nivel de memoria: nombre y tamaño del conjunto de trabajo */
+struct bench_level {
+    const char *name;
+    size_t bytes;
+};
+
+/* Bytes de datos de un objeto que lee cada kernel en la versión SOA */
+const size_t SOA_POS_BYTES = 3 * sizeof(double);                 // pos_x, pos_y, pos_z
+const size_t SOA_FORCE_BYTES = 4 * sizeof(double);               // posiciones y masa
+const size_t SOA_CALC_BYTES = 4 * sizeof(double) + sizeof(bool); // posiciones, masa y active
+const size_t SOA_BORDER_BYTES = 6 * sizeof(double);              // posiciones y velocidades
+const size_t SOA_OBJECT_BYTES = 7 * sizeof(double) + sizeof(bool);
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+/* Kernels AOS */
+double euclidean_norm(object_aos object_1, object_aos object_2);
+void vector_gravitational_force(object_aos object_1, object_aos object_2, double *forces);
+void calc_gravitational(int num_objects, int i, vector<object_aos> &objects, double *forces);
+void check_border(object_aos *object_1, double size_enclosure);
+bool check_collision(object_aos object_1, object_aos object_2);
+/* Kernels SOA */
+double euclidean_norm(object_soa objects, int i, int j);
+void vector_gravitational_force(object_soa objects, int i, int j, vector_elem *forces);
+void calc_gravitational(int num_objects, int i, object_soa objects, vector_elem *forces);
+void check_border(object_soa *objects, int i, double size_enclosure);
+bool check_collision(object_soa objects, int i, int j);
+void integrate_separate(object objects, int num_objects, vector_elem *forces, vector_elem *acceleration);
+void integrate_fused(object objects, int num_objects, vector_elem *forces);
+object as_object(object_soa objects);
+/* Comparación de backends de los bucles paralelos */
+void bench_backends();
+/* Coste del modo reproducible frente al núcleo paralelo sin restricciones */
+void bench_reproducible();
+/* Integración de Euler en bucles separados frente a la pasada fusionada */
+void bench_integration();
+/* Coste y precisión de las fuerzas con rsqrt y Newton-Raphson frente a sqrt y división */
+void bench_rsqrt();
+/* Utilidades de medida */
+size_t cache_size(int name, size_t fallback);
+template <class Kernel> double time_kernel(Kernel kernel, long interactions_per_call);
+void print_row(const char *level, const char *kernel, const char *layout, int num_objects, double ns, size_t bytes);
+
+/* MAIN */
+int main(int argc, char const *argv[])
+{
+    /* Comprobación inicial argumentos: opcionalmente el tamaño (MiB) del nivel DRAM */
+    if (argc > 2)
+    {
+        cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./bench-kernels [dram_mib]\n";
+        return -1;
+    }
+    if (argc == 2 && (atoi(argv[1]) <= 0 || atof(argv[1]) != atoi(argv[1])))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
+    /* Tamaños de los conjuntos de trabajo: la mitad de cada caché y un nivel que no cabe en L3 */
+    size_t l1 = cache_size(_SC_LEVEL1_DCACHE_SIZE, 32 * 1024);
+    size_t l2 = cache_size(_SC_LEVEL2_CACHE_SIZE, 1024 * 1024);
+    size_t l3 = cache_size(_SC_LEVEL3_CACHE_SIZE, 32 * 1024 * 1024);
+    size_t dram = (argc == 2) ? (size_t)atoi(argv[1]) * 1024 * 1024 : min(4 * l3, (size_t)1024 * 1024 * 1024);
+    vector<bench_level> levels = {{"L1", l1 / 2}, {"L2", l2 / 2}, {"L3", l3 / 2}, {"DRAM", dram}};
+
+    cout << left << setw(6) << "Level" << setw(28) << "Kernel" << setw(8) << "Layout" << right << setw(12) << "N"
+         << setw(18) << "ns/interaction" << setw(20) << "bytes/interaction" << setw(10) << "GB/s" << "\n";
+
+    for (bench_level level : levels)
+    {
+        int n_aos = max((size_t)2, level.bytes / sizeof(object_aos));
+        int n_soa = max((size_t)2, level.bytes / SOA_OBJECT_BYTES);
+
+        /* Coordenadas y masas pseudoaleatorias (mismas distribuciones que la simulación) */
+        mt19937_64 gen(RANDOM_SEED);
+        uniform_real_distribution<double> position_dist(0.0, SIZE_ENCLOSURE);
+        normal_distribution<double> mass_dist(M, SDM);
+
+        /* AOS - Array of Structs */
+        vector<object_aos> objects_aos(n_aos);
+        for (int i = 0; i < n_aos; i++)
+        {
+            objects_aos[i].pos_x = position_dist(gen);
+            objects_aos[i].pos_y = position_dist(gen);
+            objects_aos[i].pos_z = position_dist(gen);
+            objects_aos[i].mass = mass_dist(gen);
+        }
+
+        /* SOA - Structure of Arrays */
+        object_soa objects_soa;
+        objects_soa.pos_x = (double *)malloc(sizeof(double) * n_soa);
+        objects_soa.pos_y = (double *)malloc(sizeof(double) * n_soa);
+        objects_soa.pos_z = (double *)malloc(sizeof(double) * n_soa);
+        objects_soa.speed_x = (double *)calloc(n_soa, sizeof(double));
+        objects_soa.speed_y = (double *)calloc(n_soa, sizeof(double));
+        objects_soa.speed_z = (double *)calloc(n_soa, sizeof(double));
+        objects_soa.mass = (double *)malloc(sizeof(double) * n_soa);
+        objects_soa.active = (bool *)malloc(sizeof(bool) * n_soa);
+        for (int i = 0; i < n_soa; i++)
+        {
+            objects_soa.pos_x[i] = position_dist(gen);
+            objects_soa.pos_y[i] = position_dist(gen);
+            objects_soa.pos_z[i] = position_dist(gen);
+            objects_soa.mass[i] = mass_dist(gen);
+            objects_soa.active[i] = true;
+        }
+
+        // Acumulador para que el compilador no elimine los kernels
+        volatile double sink = 0;
+        int call = 0;
+        double ns;
+
+        /* euclidean_norm: un objeto contra todos los demás */
+        ns = time_kernel([&]() {
+            int i = call++ % n_aos;
+            double sum = 0;
+            for (int j = 0; j < n_aos; j++) sum += euclidean_norm(objects_aos[i], objects_aos[j]);
+            sink = sink + sum;
+        }, n_aos);
+        print_row(level.name, "euclidean_norm", "AOS", n_aos, ns, sizeof(object_aos));
+        ns = time_kernel([&]() {
+            int i = call++ % n_soa;
+            double sum = 0;
+            for (int j = 0; j < n_soa; j++) sum += euclidean_norm(objects_soa, i, j);
+            sink = sink + sum;
+        }, n_soa);
+        print_row(level.name, "euclidean_norm", "SOA", n_soa, ns, SOA_POS_BYTES);
+
+        /* vector_gravitational_force: un objeto contra todos los demás */
+        ns = time_kernel([&]() {
+            int i = call++ % n_aos;
+            double forces[3] = {0.0, 0.0, 0.0};
+            for (int j = 0; j < n_aos; j++) if (j != i) vector_gravitational_force(objects_aos[j], objects_aos[i], forces);
+            sink = sink + forces[0] + forces[1] + forces[2];
+        }, n_aos - 1);
+        print_row(level.name, "vector_gravitational_force", "AOS", n_aos, ns, sizeof(object_aos));
+        ns = time_kernel([&]() {
+            int i = call++ % n_soa;
+            vector_elem forces = {0.0, 0.0, 0.0};
+            for (int j = 0; j < n_soa; j++) if (j != i) vector_gravitational_force(objects_soa, j, i, &forces);
+            sink = sink + forces.x + forces.y + forces.z;
+        }, n_soa - 1);
+        print_row(level.name, "vector_gravitational_force", "SOA", n_soa, ns, SOA_FORCE_BYTES);
+
+        /* calc_gravitational: fuerza total sobre un objeto */
+        ns = time_kernel([&]() {
+            int i = call++ % n_aos;
+            double forces[3] = {0.0, 0.0, 0.0};
+            calc_gravitational(n_aos, i, objects_aos, forces);
+            sink = sink + forces[0] + forces[1] + forces[2];
+        }, n_aos - 1);
+        print_row(level.name, "calc_gravitational", "AOS", n_aos, ns, sizeof(object_aos));
+        ns = time_kernel([&]() {
+            int i = call++ % n_soa;
+            vector_elem forces = {0.0, 0.0, 0.0};
+            calc_gravitational(n_soa, i, objects_soa, &forces);
+            sink = sink + forces.x + forces.y + forces.z;
+        }, n_soa - 1);
+        print_row(level.name, "calc_gravitational", "SOA", n_soa, ns, SOA_CALC_BYTES);
+
+        /* check_border: una pasada sobre todos los objetos */
+        ns = time_kernel([&]() {
+            for (int i = 0; i < n_aos; i++) check_border(&objects_aos[i], SIZE_ENCLOSURE);
+        }, n_aos);
+        print_row(level.name, "check_border", "AOS", n_aos, ns, sizeof(object_aos));
+        ns = time_kernel([&]() {
+            for (int i = 0; i < n_soa; i++) check_border(&objects_soa, i, SIZE_ENCLOSURE);
+        }, n_soa);
+        print_row(level.name, "check_border", "SOA", n_soa, ns, SOA_BORDER_BYTES);
+
+        /* check_collision: un objeto contra todos los demás */
+        ns = time_kernel([&]() {
+            int i = call++ % n_aos;
+            int count = 0;
+            for (int j = 0; j < n_aos; j++) count += check_collision(objects_aos[i], objects_aos[j]);
+            sink = sink + count;
+        }, n_aos);
+        print_row(level.name, "check_collision", "AOS", n_aos, ns, sizeof(object_aos));
+        ns = time_kernel([&]() {
+            int i = call++ % n_soa;
+            int count = 0;
+            for (int j = 0; j < n_soa; j++) count += check_collision(objects_soa, i, j);
+            sink = sink + count;
+        }, n_soa);
+        print_row(level.name, "check_collision", "SOA", n_soa, ns, SOA_POS_BYTES);
+
+        free(objects_soa.pos_x);
+        free(objects_soa.pos_y);
+        free(objects_soa.pos_z);
+        free(objects_soa.speed_x);
+        free(objects_soa.speed_y);
+        free(objects_soa.speed_z);
+        free(objects_soa.mass);
+        free(objects_soa.active);
+    }
+
+    bench_backends();
+    bench_reproducible();
+    bench_integration();
+    bench_rsqrt();
+}
+
+/* Los bucles paralelos de la simulación (fuerzas y bordes por objeto, colisiones por filas de pares) con cada
+   backend de backend.hpp sobre los mismos objetos SOA. El pool es el thread_pool propio con los hilos de OpenMP */
+void bench_backends()
+{
+    int n = BACKEND_OBJECTS;
+    mt19937_64 gen(RANDOM_SEED);
+    uniform_real_distribution<double> position_dist(0.0, SIZE_ENCLOSURE);
+    normal_distribution<double> mass_dist(M, SDM);
+    object_soa objects;
+    objects.pos_x = (double *)malloc(sizeof(double) * n);
+    objects.pos_y = (double *)malloc(sizeof(double) * n);
+    objects.pos_z = (double *)malloc(sizeof(double) * n);
+    objects.speed_x = (double *)calloc(n, sizeof(double));
+    objects.speed_y = (double *)calloc(n, sizeof(double));
+    objects.speed_z = (double *)calloc(n, sizeof(double));
+    objects.mass = (double *)malloc(sizeof(double) * n);
+    objects.active = (bool *)malloc(sizeof(bool) * n);
+    for (int i = 0; i < n; i++)
+    {
+        objects.pos_x[i] = position_dist(gen);
+        objects.pos_y[i] = position_dist(gen);
+        objects.pos_z[i] = position_dist(gen);
+        objects.mass[i] = mass_dist(gen);
+        objects.active[i] = true;
+    }
+    vector<vector_elem> forces(n);
+    vector<int> collisions(n);
+
+    thread_pool threads;
+    thread_pool_init(&threads, omp_get_max_threads());
+    task_pool pool = make_task_pool(&threads);
+
+    cout << "\nBackends (" << omp_get_max_threads() << " threads, N = " << n << ")\n";
+    cout << left << setw(10) << "Backend" << setw(28) << "Loop" << right << setw(18) << "ns/interaction" << setw(14) << "vs openmp" << "\n";
+    double reference[3] = {0, 0, 0};
+    for (backend_type backend : {OPENMP, STD_PAR, TASK_POOL})
+    {
+        double ns[3];
+        /* Fuerzas: calc_gravitational de cada objeto (bucle por objeto) */
+        ns[0] = time_kernel([&]() {
+            parallel_bodies(backend, &pool, n, 64, true, [&](int i) {
+                forces[i] = {0.0, 0.0, 0.0};
+                calc_gravitational(n, i, objects, &forces[i]);
+            });
+        }, (long)n * (n - 1));
+        /* Bordes: check_border de cada objeto (bucle por objeto) */
+        ns[1] = time_kernel([&]() {
+            parallel_bodies(backend, &pool, n, 1024, true, [&](int i) {
+                check_border(&objects, i, SIZE_ENCLOSURE);
+            });
+        }, n);
+        /* Colisiones: check_collision de los pares (i, j > i) (bucle por filas de pares) */
+        ns[2] = time_kernel([&]() {
+            parallel_pairs(backend, &pool, n, [&](int i) {
+                int count = 0;
+                for (int j = i + 1; j < n; j++) count += check_collision(objects, i, j);
+                collisions[i] = count;
+            });
+        }, (long)n * (n - 1) / 2);
+        const char *loops[3] = {"calc_gravitational (bodies)", "check_border (bodies)", "check_collision (pairs)"};
+        for (int k = 0; k < 3; k++)
+        {
+            if (backend == OPENMP)
+            {
+                reference[k] = ns[k];
+            }
+            cout << left << setw(10) << backend_name(backend) << setw(28) << loops[k] << right << fixed << setprecision(3)
+                 << setw(18) << ns[k] << setw(13) << reference[k] / ns[k] << "x\n";
+        }
+    }
+
+    thread_pool_free(&threads);
+    free(objects.pos_x);
+    free(objects.pos_y);
+    free(objects.pos_z);
+    free(objects.speed_x);
+    free(objects.speed_y);
+    free(objects.speed_z);
+    free(objects.mass);
+    free(objects.active);
+}
+
+/* Fuerzas directas en paralelo con calc_gravitational (orden j creciente, el núcleo sin restricciones) y con
+   calc_gravitational_reproducible (árbol de reducción fijo de --reproducible), los dos de simulation.hpp, con
+   OpenMP. Se comprueba además que las fuerzas reproducibles son idénticas bit a bit con 1 hilo y con todos */
+void bench_reproducible()
+{
+    int n = BACKEND_OBJECTS;
+    mt19937_64 gen(RANDOM_SEED);
+    uniform_real_distribution<double> position_dist(0.0, SIZE_ENCLOSURE);
+    normal_distribution<double> mass_dist(M, SDM);
+    object_soa objects = {};
+    objects.pos_x = (double *)malloc(sizeof(double) * n);
+    objects.pos_y = (double *)malloc(sizeof(double) * n);
+    objects.pos_z = (double *)malloc(sizeof(double) * n);
+    objects.mass = (double *)malloc(sizeof(double) * n);
+    objects.active = (bool *)malloc(sizeof(bool) * n);
+    for (int i = 0; i < n; i++)
+    {
+        objects.pos_x[i] = position_dist(gen);
+        objects.pos_y[i] = position_dist(gen);
+        objects.pos_z[i] = position_dist(gen);
+        objects.mass[i] = mass_dist(gen);
+        objects.active[i] = true;
+    }
+    object view = as_object(objects);
+    vector<vector_elem> forces(n);
+    vector<vector_elem> serial(n);
+    int threads = omp_get_max_threads();
+
+    double ns[2];
+    ns[0] = time_kernel([&]() {
+        parallel_bodies(OPENMP, NULL, n, 64, true, [&](int i) {
+            forces[i] = {0.0, 0.0, 0.0};
+            calc_gravitational(n, i, view, &forces[i]);
+        });
+    }, (long)n * (n - 1));
+    ns[1] = time_kernel([&]() {
+        parallel_bodies(OPENMP, NULL, n, 64, true, [&](int i) {
+            forces[i] = {0.0, 0.0, 0.0};
+            calc_gravitational_reproducible(n, i, view, &forces[i]);
+        });
+    }, (long)n * (n - 1));
+
+    omp_set_num_threads(1);
+    parallel_bodies(OPENMP, NULL, n, 64, true, [&](int i) {
+        serial[i] = {0.0, 0.0, 0.0};
+        calc_gravitational_reproducible(n, i, view, &serial[i]);
+    });
+    omp_set_num_threads(threads);
+    bool identical = true;
+    for (int i = 0; i < n; i++)
+    {
+        identical = identical && forces[i].x == serial[i].x && forces[i].y == serial[i].y && forces[i].z == serial[i].z;
+    }
+
+    cout << "\nReproducible forces (" << threads << " threads, N = " << n << ")\n";
+    cout << left << setw(38) << "Kernel" << right << setw(18) << "ns/interaction" << setw(14) << "overhead" << "\n";
+    cout << left << setw(38) << "calc_gravitational (unconstrained)" << right << fixed << setprecision(3) << setw(18) << ns[0] << setw(14) << "-" << "\n";
+    cout << left << setw(38) << "calc_gravitational_reproducible" << right << fixed << setprecision(3) << setw(18) << ns[1]
+         << setw(13) << 100.0 * (ns[1] / ns[0] - 1) << "%\n";
+    cout << "Bit-identical with 1 and " << threads << " threads: " << (identical ? "yes" : "no") << "\n";
+
+    free(objects.pos_x);
+    free(objects.pos_y);
+    free(objects.pos_z);
+    free(objects.mass);
+    free(objects.active);
+}
+
+/* Integración de Euler tras las fuerzas con los cuatro bucles por objeto de antes (aceleración, velocidad,
+   posición y bordes) y con la pasada fusionada de simulation.hpp (integrate_body), con OpenMP, sobre objetos
+   que no caben en L3. Se comprueba además que las dos dan el mismo resultado bit a bit */
+void bench_integration()
+{
+    int n = INTEGRATION_OBJECTS;
+    mt19937_64 gen(RANDOM_SEED);
+    uniform_real_distribution<double> position_dist(0.0, SIZE_ENCLOSURE);
+    uniform_real_distribution<double> speed_dist(-SIZE_ENCLOSURE, SIZE_ENCLOSURE);
+    normal_distribution<double> mass_dist(M, SDM);
+    object_soa objects[2];
+    for (object_soa &copy : objects)
+    {
+        copy.pos_x = (double *)malloc(sizeof(double) * n);
+        copy.pos_y = (double *)malloc(sizeof(double) * n);
+        copy.pos_z = (double *)malloc(sizeof(double) * n);
+        copy.speed_x = (double *)malloc(sizeof(double) * n);
+        copy.speed_y = (double *)malloc(sizeof(double) * n);
+        copy.speed_z = (double *)malloc(sizeof(double) * n);
+        copy.mass = (double *)malloc(sizeof(double) * n);
+        copy.active = (bool *)malloc(sizeof(bool) * n);
+    }
+    vector<vector_elem> forces(n);
+    vector<vector_elem> acceleration(n);
+    for (int i = 0; i < n; i++)
+    {
+        double values[7] = {position_dist(gen), position_dist(gen), position_dist(gen), speed_dist(gen), speed_dist(gen), speed_dist(gen), mass_dist(gen)};
+        for (object_soa &copy : objects)
+        {
+            copy.pos_x[i] = values[0];
+            copy.pos_y[i] = values[1];
+            copy.pos_z[i] = values[2];
+            copy.speed_x[i] = values[3];
+            copy.speed_y[i] = values[4];
+            copy.speed_z[i] = values[5];
+            copy.mass[i] = values[6];
+            copy.active[i] = i % 16 != 0;
+        }
+        forces[i] = {values[6] * speed_dist(gen), values[6] * speed_dist(gen), values[6] * speed_dist(gen)};
+    }
+
+    /* Un paso con cada versión desde el mismo estado: deben coincidir */
+    object views[2] = {as_object(objects[0]), as_object(objects[1])};
+    integrate_separate(views[0], n, forces.data(), acceleration.data());
+    integrate_fused(views[1], n, forces.data());
+    bool identical = true;
+    for (int i = 0; i < n; i++)
+    {
+        identical = identical && objects[0].pos_x[i] == objects[1].pos_x[i] && objects[0].pos_y[i] == objects[1].pos_y[i]
+                    && objects[0].pos_z[i] == objects[1].pos_z[i] && objects[0].speed_x[i] == objects[1].speed_x[i]
+                    && objects[0].speed_y[i] == objects[1].speed_y[i] && objects[0].speed_z[i] == objects[1].speed_z[i];
+    }
+
+    double ns[2];
+    ns[0] = time_kernel([&]() { integrate_separate(views[0], n, forces.data(), acceleration.data()); }, n);
+    ns[1] = time_kernel([&]() { integrate_fused(views[1], n, forces.data()); }, n);
+
+    cout << "\nIntegration (" << omp_get_max_threads() << " threads, N = " << n << ")\n";
+    cout << left << setw(38) << "Kernel" << right << setw(18) << "ns/object" << setw(14) << "speedup" << "\n";
+    cout << left << setw(38) << "4 loops (acceleration..border)" << right << fixed << setprecision(3) << setw(18) << ns[0] << setw(14) << "-" << "\n";
+    cout << left << setw(38) << "integrate_body (fused)" << right << fixed << setprecision(3) << setw(18) << ns[1]
+         << setw(13) << ns[0] / ns[1] << "x\n";
+    cout << "Bit-identical: " << (identical ? "yes" : "no") << "\n";
+
+    for (object_soa &copy : objects)
+    {
+        free(copy.pos_x);
+        free(copy.pos_y);
+        free(copy.pos_z);
+        free(copy.speed_x);
+        free(copy.speed_y);
+        free(copy.speed_z);
+        free(copy.mass);
+        free(copy.active);
+    }
+}
+
+/* Fuerzas directas en paralelo con calc_gravitational (sqrt y división por par) y con calc_gravitational_rsqrt
+   de --rsqrt con uno y dos pasos de Newton-Raphson, los dos de simulation.hpp, con OpenMP. La precisión se mide
+   frente a calc_gravitational: error relativo de 1/r^3 (rsqrt_estimate) en todos los pares y error relativo del
+   módulo de la fuerza total de cada objeto */
+void bench_rsqrt()
+{
+    int n = BACKEND_OBJECTS;
+    mt19937_64 gen(RANDOM_SEED);
+    uniform_real_distribution<double> position_dist(0.0, SIZE_ENCLOSURE);
+    normal_distribution<double> mass_dist(M, SDM);
+    object_soa objects = {};
+    objects.pos_x = (double *)malloc(sizeof(double) * n);
+    objects.pos_y = (double *)malloc(sizeof(double) * n);
+    objects.pos_z = (double *)malloc(sizeof(double) * n);
+    objects.mass = (double *)malloc(sizeof(double) * n);
+    objects.active = (bool *)malloc(sizeof(bool) * n);
+    for (int i = 0; i < n; i++)
+    {
+        objects.pos_x[i] = position_dist(gen);
+        objects.pos_y[i] = position_dist(gen);
+        objects.pos_z[i] = position_dist(gen);
+        objects.mass[i] = mass_dist(gen);
+        objects.active[i] = true;
+    }
+    object view = as_object(objects);
+    vector<vector_elem> exact(n);
+    vector<vector_elem> forces(n);
+
+    cout << "\nRsqrt forces (" << omp_get_max_threads() << " threads, N = " << n << ")\n";
+    cout << left << setw(38) << "Kernel" << right << setw(18) << "ns/interaction" << setw(10) << "speedup"
+         << setw(16) << "max err 1/r^3" << setw(16) << "max err force" << setw(16) << "rms err force" << "\n";
+    double reference = time_kernel([&]() {
+        parallel_bodies(OPENMP, NULL, n, 64, true, [&](int i) {
+            exact[i] = {0.0, 0.0, 0.0};
+            calc_gravitational(n, i, view, &exact[i]);
+        });
+    }, (long)n * (n - 1));
+    cout << left << setw(38) << "calc_gravitational (sqrt, division)" << right << fixed << setprecision(3) << setw(18) << reference
+         << setw(10) << "-" << setw(16) << "-" << setw(16) << "-" << setw(16) << "-" << "\n";
+    for (int refinements = 1; refinements <= 2; refinements++)
+    {
+        double ns = time_kernel([&]() {
+            parallel_bodies(OPENMP, NULL, n, 64, true, [&](int i) {
+                forces[i] = {0.0, 0.0, 0.0};
+                calc_gravitational_rsqrt(0, n, i, view, refinements, &forces[i]);
+            });
+        }, (long)n * (n - 1));
+
+        double pair_error = 0;
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = i + 1; j < n; j++)
+            {
+                double dx = objects.pos_x[i] - objects.pos_x[j];
+                double dy = objects.pos_y[i] - objects.pos_y[j];
+                double dz = objects.pos_z[i] - objects.pos_z[j];
+                double r2 = dx * dx + dy * dy + dz * dz;
+                double dist = sqrt(r2);
+                double y = rsqrt_estimate(r2, refinements);
+                pair_error = max(pair_error, fabs(y * y * y * (dist * dist * dist) - 1));
+            }
+        }
+        double max_error = 0;
+        double sum_error = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double dx = forces[i].x - exact[i].x;
+            double dy = forces[i].y - exact[i].y;
+            double dz = forces[i].z - exact[i].z;
+            double error = sqrt(dx * dx + dy * dy + dz * dz) / sqrt(exact[i].x * exact[i].x + exact[i].y * exact[i].y + exact[i].z * exact[i].z);
+            max_error = max(max_error, error);
+            sum_error += error * error;
+        }
+
+        string name = "calc_gravitational_rsqrt (" + to_string(refinements) + " NR)";
+        cout << left << setw(38) << name << right << fixed << setprecision(3) << setw(18) << ns << setw(9) << reference / ns << "x"
+             << scientific << setprecision(2) << setw(16) << pair_error << setw(16) << max_error << setw(16) << sqrt(sum_error / n) << "\n";
+    }
+    cout << fixed;
+
+    free(objects.pos_x);
+    free(objects.pos_y);
+    free(objects.pos_z);
+    free(objects.mass);
+    free(objects.active);
+}
+
+/* FUNCIONES DE MEDIDA */
+/* Tamaño de una caché según el sistema (o el valor por defecto si no se conoce) */
+size_t cache_size(int name, size_t fallback)
+{
+    long size = sysconf(name);
+    return size > 0 ? (size_t)size : fallback;
+}
+
+/* Ejecuta el kernel hasta superar MIN_TIME y devuelve la mejor media en ns por interacción */
+template <class Kernel>
+double time_kernel(Kernel kernel, long interactions_per_call)
+{
+    double best = numeric_limits<double>::max();
+    for (int rep = 0; rep < NUM_REPS; rep++)
+    {
+        long calls = 0;
+        double start = omp_get_wtime();
+        double elapsed;
+        do
+        {
+            kernel();
+            calls++;
+            elapsed = omp_get_wtime() - start;
+        } while (elapsed < MIN_TIME);
+        best = min(best, elapsed * 1E9 / ((double)calls * interactions_per_call));
+    }
+    return best;
+}
+
+/* Imprime una fila de resultados. bytes son los bytes de datos de objeto leídos por interacción */
+void print_row(const char *level, const char *kernel, const char *layout, int num_objects, double ns, size_t bytes)
+{
+    cout << left << setw(6) << level << setw(28) << kernel << setw(8) << layout << right << setw(12) << num_objects
+         << fixed << setprecision(3) << setw(18) << ns << setw(20) << bytes << setw(10) << bytes / ns << "\n";
+}
+
+/* Vista object de simulation.hpp sobre las columnas SOA, para medir los kernels de la simulación tal cual
+   (sin ids: ninguno de los medidos los usa) */
+object as_object(object_soa objects)
+{
+    object view;
+    view.pos_x = objects.pos_x;
+    view.pos_y = objects.pos_y;
+    view.pos_z = objects.pos_z;
+    view.speed_x = objects.speed_x;
+    view.speed_y = objects.speed_y;
+    view.speed_z = objects.speed_z;
+    view.mass = objects.mass;
+    view.active = objects.active;
+    view.id = NULL;
+    return view;
+}
+
+/* Integración de Euler en cuatro bucles por objeto con los kernels de simulation.hpp: aceleración, velocidad,
+   posición y bordes (el paso de Euler de Simulation antes de fusionarlo) */
+void integrate_separate(object objects, int num_objects, vector_elem *forces, vector_elem *acceleration)
+{
+    parallel_bodies(OPENMP, NULL, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            vector_acceleration(objects, i, &forces[i], &acceleration[i]);
+        }
+    });
+    parallel_bodies(OPENMP, NULL, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            vector_speed(&objects, i, &acceleration[i], TIME_STEP);
+        }
+    });
+    parallel_bodies(OPENMP, NULL, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            vector_position(&objects, i, TIME_STEP);
+        }
+    });
+    parallel_bodies(OPENMP, NULL, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            check_border(&objects, i, SIZE_ENCLOSURE);
+        }
+    });
+}
+
+/* Integración de Euler en una sola pasada por objeto, igual que el paso de Euler de Simulation::step:
+   vector_acceleration e integrate_body de simulation.hpp */
+void integrate_fused(object objects, int num_objects, vector_elem *forces)
+{
+    parallel_bodies(OPENMP, NULL, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            vector_elem acceleration;
+            vector_acceleration(objects, i, &forces[i], &acceleration);
+            integrate_body(objects, i, &acceleration, TIME_STEP, TIME_STEP, SIZE_ENCLOSURE);
+        }
+    });
+}
+
+/* KERNELS AOS (copiados de sim-aos-opti.cpp) */
+/* Distancia euclídea entre dos objetos */
+double euclidean_norm(object_aos object_1, object_aos object_2) {
+    return std::sqrt((object_1.pos_x - object_2.pos_x) * (object_1.pos_x - object_2.pos_x) + (object_1.pos_y - object_2.pos_y) * (object_1.pos_y - object_2.pos_y) + (object_1.pos_z - object_2.pos_z) * (object_1.pos_z - object_2.pos_z));
+}
+
+/* Fuerza gravitatoria entre dos objetos */
+void vector_gravitational_force(object_aos object_1, object_aos object_2, double *forces) {
+    double dist = euclidean_norm(object_1, object_2);
+    double Fg = GRAVITY_CONST * object_1.mass * object_2.mass/ (dist*dist*dist);
+    forces[0] += (Fg * (object_1.pos_x - object_2.pos_x));
+    forces[1] += (Fg * (object_1.pos_y - object_2.pos_y));
+    forces[2] += (Fg * (object_1.pos_z - object_2.pos_z));
+}
+
+/* Fuerza gravitatoria que ejerce un objeto */
+void calc_gravitational(int num_objects, int i, std::vector<object_aos> &objects, double *forces) {
+    for (int j = 0; j < num_objects; j++) {
+        if (j != i) {
+            vector_gravitational_force(objects[j], objects[i], forces);
+        }
+    }
+}
+
+/* Función para recolocar al objeto si traspasa los límites */
+void check_border(object_aos *object_1, double size_enclosure) {
+    // Checks posición x
+    if (object_1->pos_x <= 0) {
+        object_1->pos_x = 0;
+        object_1->speed_x = -1 * (object_1->speed_x);
+    } else if (object_1->pos_x >= size_enclosure) {
+        object_1->pos_x = size_enclosure;
+        object_1->speed_x = -1 * (object_1->speed_x);
+    }
+
+    // Checks posición y
+    if (object_1->pos_y <= 0) {
+        object_1->pos_y = 0;
+        object_1->speed_y = -1 * (object_1->speed_y);
+    } else if (object_1->pos_y >= size_enclosure) {
+        object_1->pos_y = size_enclosure;
+        object_1->speed_y = -1 * (object_1->speed_y);
+    }
+
+    // Checks posición z
+    if (object_1->pos_z <= 0) {
+        object_1->pos_z = 0;
+        object_1->speed_z = -1 * (object_1->speed_z);
+    } else if (object_1->pos_z >= size_enclosure) {
+        object_1->pos_z = size_enclosure;
+        object_1->speed_z = -1 * (object_1->speed_z);
+    }
+}
+
+/* Comprobar colisión entre dos objetos (distancia euclídea entre objetos menor que 1) */
+bool check_collision(object_aos object_1, object_aos object_2) {
+    if (euclidean_norm(object_1, object_2) < 1) {
+        return true;
+    }
+    return false;
+}
+
+/* KERNELS SOA (copiados de sim-psoa.cpp) */
+/* Distancia euclídea entre dos objetos */
+double euclidean_norm(object_soa objects, int i, int j)
+{
+    return std::sqrt((objects.pos_x[i]- objects.pos_x[j]) * (objects.pos_x[i]- objects.pos_x[j]) + (objects.pos_y[i]- objects.pos_y[j]) * (objects.pos_y[i]- objects.pos_y[j]) + (objects.pos_z[i]- objects.pos_z[j]) * (objects.pos_z[i]- objects.pos_z[j]));
+}
+
+/* Fuerza gravitatoria entre dos objetos */
+void vector_gravitational_force(object_soa objects, int i, int j, vector_elem *forces)
+{
+    double dist = euclidean_norm(objects, i, j);
+    double Fg = GRAVITY_CONST * objects.mass[i] * objects.mass[j]/ (dist*dist*dist);
+    forces->x += (Fg * (objects.pos_x[i] - objects.pos_x[j]));
+    forces->y += (Fg * (objects.pos_y[i] - objects.pos_y[j]));
+    forces->z += (Fg * (objects.pos_z[i] - objects.pos_z[j]));
+}
+
+/* Fuerza gravitatoria que ejerce un objeto */
+void calc_gravitational(int num_objects, int i, object_soa objects, vector_elem *forces)
+{
+    for (int j = 0; j < num_objects; j++){
+        if (j != i && objects.active[j]==true){
+            vector_gravitational_force(objects, j, i, forces);
+        }
+    }
+}
+
+/* Función para recolocar al objeto si traspasa los límites */
+void check_border(object_soa *objects, int i, double size_enclosure)
+{
+    // Checks posición x
+    if (objects->pos_x[i] <= 0)
+    {
+        objects->pos_x[i] = 0;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+    else if (objects->pos_x[i] >= size_enclosure)
+    {
+        objects->pos_x[i] = size_enclosure;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+
+    // Checks posición y
+    if (objects->pos_y[i] <= 0)
+    {
+        objects->pos_y[i] = 0;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+    else if (objects->pos_y[i] >= size_enclosure)
+    {
+        objects->pos_y[i] = size_enclosure;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+
+    // Checks posición z
+    if (objects->pos_z[i] <= 0)
+    {
+        objects->pos_z[i] = 0;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }
+    else if (objects->pos_z[i] >= size_enclosure)
+    {
+        objects->pos_z[i] = size_enclosure;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }
+}
+
+/* Comprobar colisión entre dos objetos (distancia euclídea entre objetos menor que 1) */
+bool check_collision(object_soa objects, int i, int j)
+{
+    if (euclidean_norm(objects, i, j) < 1)
+    {
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,376 @@
+/* Códec de instantáneas comprimidas: cuantiza cada columna con una cota de error (posiciones respecto a
+   size_enclosure, velocidades respecto a la mayor velocidad de la instantánea; la masa sin pérdida), codifica
+   la diferencia con la instantánea anterior (las posiciones, con la predicción de la velocidad) y comprime cada
+   columna SOA por separado y en paralelo con zlib */
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+/* Librerias */
+#include <cmath>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+/* CONSTANTES */
+const int CODEC_COLUMNS = 7;            // pos_x, pos_y, pos_z, speed_x, speed_y, speed_z, mass
+const int CODEC_STREAMS = CODEC_COLUMNS + 1;  // Las columnas y los ids
+const int CODEC_KEYFRAME = 32;          // Una instantánea completa (sin diferencias) cada CODEC_KEYFRAME
+const int CODEC_PHASE[CODEC_STREAMS] = {1, 1, 1, 0, 0, 0, 0, 0}; // Las posiciones después de las velocidades
+const uint32_t CODEC_VERSION = 1;
+const char CODEC_MAGIC[4] = {'N', 'B', 'S', 'C'};
+
+/* ESTRUCTURAS */
+/* Estructura frame: los objetos vivos de una instantánea, en orden de creación */
+struct codec_frame {
+    float size_enclosure;
+    float time_step;
+    int iteration;                              // Iteración de la instantánea (para el tiempo transcurrido)
+    int created;                                // Objetos creados (los ids van de 0 a created - 1)
+    std::vector<int> id;                        // Ids de los objetos vivos, en orden creciente
+    std::vector<double> column[CODEC_COLUMNS];
+};
+
+/* Estructura estado del códec: lo que el codificador y el decodificador recuerdan de la instantánea anterior.
+   Las diferencias se toman contra los valores reconstruidos, así el error no se acumula entre instantáneas */
+struct codec_state {
+    int created = 0;
+    int iteration = 0;
+    int frames = 0;                             // Instantáneas desde la última completa (0: la siguiente es completa)
+    std::vector<double> previous[CODEC_COLUMNS]; // Valores reconstruidos por id
+    std::vector<double> start_speed[3];          // Velocidades reconstruidas de la instantánea anterior a previous
+};
+
+/* Estructura cabecera del fichero */
+struct codec_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t keyframe;                          // 1 si no depende de la instantánea anterior
+    uint32_t columns;                           // CODEC_COLUMNS
+    float size_enclosure;
+    float time_step;
+    int32_t created;
+    int32_t count;                              // Objetos vivos
+    double elapsed;                             // Tiempo desde la instantánea anterior (0 en las completas)
+    double quantum[CODEC_COLUMNS];              // Paso de cuantización de cada columna (0: sin pérdida)
+    uint64_t raw_size[CODEC_STREAMS];           // Bytes de cada columna antes y después de zlib
+    uint64_t packed_size[CODEC_STREAMS];
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+inline void codec_put_varint(std::string *bytes, uint64_t value);
+inline bool codec_get_varint(const std::string &bytes, size_t *offset, uint64_t *value);
+inline uint64_t codec_zigzag(int64_t value);
+inline int64_t codec_unzigzag(uint64_t value);
+inline uint64_t codec_bits(double value);
+inline double codec_double(uint64_t bits);
+inline void codec_reset(codec_state *state, int created);
+inline double codec_predict(const codec_header *header, const codec_state *state, int c, int id);
+inline void codec_pack(const codec_header *header, int s, const codec_frame *frame, codec_state *state, std::string *raw);
+inline bool codec_unpack(const codec_header *header, int c, const std::string &raw, codec_state *state, codec_frame *frame);
+inline void codec_encode(const codec_frame *frame, double error, codec_state *state, std::string *output);
+inline bool codec_decode(const std::string &input, codec_state *state, codec_frame *frame);
+
+/* FUNCIONES */
+/* Entero sin signo en base 128 (7 bits por byte, el bit alto indica que sigue otro byte) */
+inline void codec_put_varint(std::string *bytes, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        bytes->push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    bytes->push_back((char)value);
+}
+
+/* Lee un entero de codec_put_varint desde bytes[*offset] (false si se acaban los bytes) */
+inline bool codec_get_varint(const std::string &bytes, size_t *offset, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *offset < bytes.size(); shift += 7)
+    {
+        uint8_t byte = bytes[(*offset)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Enteros con signo a sin signo con los pequeños en valor absoluto primero (0, -1, 1, -2, ...) */
+inline uint64_t codec_zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t codec_unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Bits de un double y viceversa (la masa se codifica sin pérdida) */
+inline uint64_t codec_bits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline double codec_double(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Olvida la instantánea anterior: la siguiente parte de cero */
+inline void codec_reset(codec_state *state, int created)
+{
+    state->created = created;
+    for (int c = 0; c < CODEC_COLUMNS; c++)
+    {
+        state->previous[c].assign(created, 0.0);
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        state->start_speed[c].assign(created, 0.0);
+    }
+}
+
+/* Valor de la columna c del objeto id que se espera en esta instantánea: el reconstruido anterior y, en las
+   posiciones, más la media de la velocidad anterior y la ya reconstruida de esta instantánea por el tiempo
+   transcurrido (regla del trapecio) */
+inline double codec_predict(const codec_header *header, const codec_state *state, int c, int id)
+{
+    double value = state->previous[c][id];
+    if (c < 3)
+    {
+        value += 0.5 * (state->start_speed[c][id] + state->previous[c + 3][id]) * header->elapsed;
+    }
+    return value;
+}
+
+/* Codifica el flujo s (una columna o los ids) de frame en raw y actualiza los valores reconstruidos */
+inline void codec_pack(const codec_header *header, int s, const codec_frame *frame, codec_state *state, std::string *raw)
+{
+    int count = frame->id.size();
+    raw->reserve((size_t)count * 2);
+    if (s == CODEC_COLUMNS)
+    {
+        // Ids: saltos entre ids consecutivos
+        int last = -1;
+        for (int k = 0; k < count; k++)
+        {
+            codec_put_varint(raw, frame->id[k] - last - 1);
+            last = frame->id[k];
+        }
+        return;
+    }
+    std::vector<double> &previous = state->previous[s];
+    for (int k = 0; k < count; k++)
+    {
+        int id = frame->id[k];
+        double value = frame->column[s][k];
+        if (header->quantum[s] == 0)
+        {
+            // Sin pérdida: bits que cambian respecto a la anterior (casi siempre ninguno)
+            codec_put_varint(raw, codec_bits(value) ^ codec_bits(previous[id]));
+            previous[id] = value;
+        }
+        else
+        {
+            double expected = codec_predict(header, state, s, id);
+            int64_t steps = std::llround((value - expected) / header->quantum[s]);
+            codec_put_varint(raw, codec_zigzag(steps));
+            if (s >= 3)
+            {
+                state->start_speed[s - 3][id] = previous[id];
+            }
+            previous[id] = expected + steps * header->quantum[s];
+        }
+    }
+}
+
+/* Decodifica la columna c de raw en frame (con frame->id ya decodificado) y actualiza los valores reconstruidos */
+inline bool codec_unpack(const codec_header *header, int c, const std::string &raw, codec_state *state, codec_frame *frame)
+{
+    int count = frame->id.size();
+    std::vector<double> &previous = state->previous[c];
+    frame->column[c].resize(count);
+    size_t position = 0;
+    for (int k = 0; k < count; k++)
+    {
+        uint64_t value;
+        if (!codec_get_varint(raw, &position, &value))
+        {
+            return false;
+        }
+        int id = frame->id[k];
+        if (header->quantum[c] == 0)
+        {
+            previous[id] = codec_double(value ^ codec_bits(previous[id]));
+        }
+        else
+        {
+            double expected = codec_predict(header, state, c, id);
+            if (c >= 3)
+            {
+                state->start_speed[c - 3][id] = previous[id];
+            }
+            previous[id] = expected + codec_unzigzag(value) * header->quantum[c];
+        }
+        frame->column[c][k] = previous[id];
+    }
+    return true;
+}
+
+/* Codifica frame en output. error es la cota relativa: las posiciones se reconstruyen con un error menor que
+   error * size_enclosure y las velocidades con un error menor que error * (mayor |velocidad| de la instantánea).
+   Cada columna se cuantiza como la diferencia con su valor esperado (codec_predict, cero en las completas), se
+   guarda en base 128 y se comprime con zlib, todas las columnas en paralelo (en dos fases: las posiciones
+   necesitan las velocidades reconstruidas) */
+inline void codec_encode(const codec_frame *frame, double error, codec_state *state, std::string *output)
+{
+    bool keyframe = state->frames == 0 || state->created != frame->created;
+    if (keyframe)
+    {
+        codec_reset(state, frame->created);
+    }
+    state->frames = (state->frames + 1) % CODEC_KEYFRAME;
+
+    codec_header header;
+    memcpy(header.magic, CODEC_MAGIC, sizeof(header.magic));
+    header.version = CODEC_VERSION;
+    header.keyframe = keyframe;
+    header.columns = CODEC_COLUMNS;
+    header.size_enclosure = frame->size_enclosure;
+    header.time_step = frame->time_step;
+    header.created = frame->created;
+    header.count = frame->id.size();
+    header.elapsed = keyframe ? 0.0 : (frame->iteration - state->iteration) * (double)frame->time_step;
+    state->iteration = frame->iteration;
+    double max_speed = 0;
+    for (int c = 3; c < 6; c++)
+    {
+        for (double value : frame->column[c])
+        {
+            max_speed = std::max(max_speed, std::fabs(value));
+        }
+    }
+    for (int c = 0; c < CODEC_COLUMNS; c++)
+    {
+        header.quantum[c] = c < 3 ? 2 * error * frame->size_enclosure : c < 6 ? (max_speed > 0 ? 2 * error * max_speed : 1.0) : 0.0;
+    }
+
+    std::string packed[CODEC_STREAMS];
+    for (int phase = 0; phase < 2; phase++)
+    {
+        #pragma omp parallel for schedule(dynamic)
+        for (int s = 0; s < CODEC_STREAMS; s++)
+        {
+            if (CODEC_PHASE[s] != phase)
+            {
+                continue;
+            }
+            std::string raw;
+            codec_pack(&header, s, frame, state, &raw);
+            uLongf size = compressBound(raw.size());
+            packed[s].resize(size);
+            compress2((Bytef*)&packed[s][0], &size, (const Bytef*)raw.data(), raw.size(), Z_DEFAULT_COMPRESSION);
+            packed[s].resize(size);
+            header.raw_size[s] = raw.size();
+            header.packed_size[s] = size;
+        }
+    }
+
+    output->assign((const char*)&header, sizeof(header));
+    for (int s = 0; s < CODEC_STREAMS; s++)
+    {
+        output->append(packed[s]);
+    }
+}
+
+/* Decodifica input en frame con el estado de la instantánea anterior (las instantáneas de una serie se tienen
+   que decodificar en orden desde una completa). Devuelve false si los datos no son válidos o falta la anterior */
+inline bool codec_decode(const std::string &input, codec_state *state, codec_frame *frame)
+{
+    codec_header header;
+    if (input.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, input.data(), sizeof(header));
+    if (memcmp(header.magic, CODEC_MAGIC, sizeof(header.magic)) != 0 || header.version != CODEC_VERSION || header.columns != CODEC_COLUMNS || header.count < 0 || header.count > header.created)
+    {
+        return false;
+    }
+    if (header.keyframe)
+    {
+        codec_reset(state, header.created);
+    }
+    else if (state->created != header.created)
+    {
+        return false;
+    }
+    int count = header.count;
+    frame->size_enclosure = header.size_enclosure;
+    frame->time_step = header.time_step;
+    frame->created = header.created;
+    frame->id.resize(count);
+
+    size_t offset[CODEC_STREAMS];
+    size_t total = sizeof(header);
+    for (int s = 0; s < CODEC_STREAMS; s++)
+    {
+        offset[s] = total;
+        total += header.packed_size[s];
+    }
+    if (total != input.size())
+    {
+        return false;
+    }
+
+    std::string raw[CODEC_STREAMS];
+    bool valid = true;
+    #pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < CODEC_STREAMS; s++)
+    {
+        uLongf size = header.raw_size[s];
+        raw[s].resize(size);
+        if (uncompress((Bytef*)&raw[s][0], &size, (const Bytef*)input.data() + offset[s], header.packed_size[s]) != Z_OK || size != header.raw_size[s])
+        {
+            #pragma omp atomic write
+            valid = false;
+        }
+    }
+
+    /* Primero los ids, que indican qué valor anterior corresponde a cada objeto */
+    size_t position = 0;
+    int last = -1;
+    for (int k = 0; k < count && valid; k++)
+    {
+        uint64_t gap;
+        valid = codec_get_varint(raw[CODEC_COLUMNS], &position, &gap) && last + 1 + (int64_t)gap < header.created;
+        last = frame->id[k] = valid ? last + 1 + gap : -1;
+    }
+
+    /* Después las columnas, en las mismas fases que el codificador */
+    for (int phase = 0; phase < 2 && valid; phase++)
+    {
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < CODEC_COLUMNS; c++)
+        {
+            if (CODEC_PHASE[c] == phase && !codec_unpack(&header, c, raw[c], state, frame))
+            {
+                #pragma omp atomic write
+                valid = false;
+            }
+        }
+    }
+    return valid;
+}
+
+#endif
@@ -5,6 +5,17 @@
 #include <random>
 #include <vector>
 #include <iomanip>
+#include <string>
+#include <sstream>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <omp.h>
+#include <sys/stat.h>
+#include "arena.hpp"
 #include <opencv2/opencv.hpp>
 using namespace std;
 
@@ -12,6 +23,8 @@ using namespace std;
 const double GRAVITY_CONST = 6.674 * 1E-11; // Constante gravedad universal
 const double M = 1E21;                      // Media (distribución normal)
 const double SDM = 1E15;                    // Desviación (distribución normal)
+const size_t VIDEO_QUEUE = 8;               // Fotogramas máximos en la cola del codificador de vídeo
+const double VIDEO_FPS = 30;                // Fotogramas por segundo del vídeo
 
 /* ESTRUCTURAS */
 /* Estructura objeto */
@@ -33,6 +46,60 @@ struct vector_elem {
     double z;
 };
 
+/* Tipos de pintado */
+enum renderer_type {CIRCLES, SPLAT};
+
+/* Estructura opciones: argumentos opcionales tras los obligatorios */
+struct sim_options {
+    renderer_type renderer; // Un círculo por objeto o histograma de densidad
+    bool headless; // Sin ventana: los fotogramas se guardan en frames/ (servidores sin pantalla)
+    string video;  // Fichero de vídeo ("" = sin vídeo)
+    int every;     // Se codifica un fotograma cada 'every' iteraciones
+};
+
+/* Estructura render_buffer: doble buffer entre la simulación y el hilo de pintado.
+   La simulación escribe en slots[1 - front] y solo intercambia si el hilo de pintado no está pintando;
+   si está ocupado el fotograma se descarta, así la simulación nunca espera al pintado */
+struct render_buffer {
+    vector<object> slots[2];       // Instantáneas de los objetos; el hilo de pintado lee slots[front]
+    int iteration[2] = {0, 0};     // Iteración de cada instantánea
+    int front = 0;                 // Solo lo modifica la simulación (con lock)
+    bool fresh = false;            // slots[front] todavía no se ha pintado
+    bool done = false;             // La simulación ha terminado
+    atomic<bool> rendering{false}; // El hilo de pintado está leyendo slots[front]
+    atomic<bool> stop{false};      // Se ha pulsado Esc en la ventana
+    mutex lock;
+    condition_variable ready;
+    long published = 0;            // Estadísticas de fotogramas
+    long rendered = 0;
+    long dropped = 0;
+};
+
+/* Estructura frame_queue: cola acotada entre la simulación y el hilo codificador de vídeo.
+   Si la cola está llena la simulación espera, así ningún fotograma del vídeo se pierde */
+struct frame_queue {
+    deque<cv::Mat> frames;
+    bool done = false;             // La simulación ha terminado
+    mutex lock;
+    condition_variable not_empty;
+    condition_variable not_full;
+    long pushed = 0;               // Estadísticas
+    long encoded = 0;
+    size_t max_depth = 0;
+    long depth_sum = 0;            // Suma de la profundidad de la cola tras cada push
+    double blocked_time = 0;       // Tiempo que la simulación ha esperado con la cola llena
+    double encode_time = 0;        // Tiempo del codificador dentro de VideoWriter::write
+};
+
+/* Estructura splat_histograms: histogramas 2D por hilo del pintado por densidad.
+   Se reservan una vez por hilo de pintado y se reutilizan en cada fotograma */
+struct splat_histograms {
+    int threads = 0;
+    vector<float> density;         // threads * rows * cols: objetos por píxel
+    vector<float> mass;            // threads * rows * cols: masa por píxel
+    cv::Mat palette;               // 256 colores (COLORMAP_INFERNO) indexados por la masa media
+};
+
 /* DECLARACIÓN PREVIA DE FUNCIONES */
 void vector_gravitational_force(object object_1, object object_2, double *forces);
 void calc_gravitational(int num_objects, int index_1, vector<object> &objects, double *forces);
@@ -41,14 +108,22 @@ void vector_speed(object *object_1, vector_elem *acceleration, double time_step)
 void vector_position(object *object_1, double time_step);
 void check_border(object *object_1, double size_enclosure);
 bool check_collision(object object_1, object object_2);
+bool parse_options(int argc, char const *argv[], sim_options *options);
+void publish_snapshot(render_buffer *buffer, vector<object> &objects, int iteration);
+void render_loop(render_buffer *buffer, sim_options *options, double size_enclosure, float scale_factor);
+void render_frame(vector<object> &snapshot, cv::Mat &canvas, float scale_factor, std::unordered_map<int, cv::Scalar> &color_map);
+std::unordered_map<int, cv::Scalar> make_color_map();
+void render_splat(vector<object> &snapshot, cv::Mat &canvas, float scale_factor, splat_histograms *histograms);
+void push_frame(frame_queue *queue, cv::Mat &frame);
+void encode_loop(frame_queue *queue, cv::VideoWriter *writer);
 
 /* MAIN */
 int main(int argc, char const *argv[]) {
     /* Comprobación número inicial argumentos */
-    if (argc != 6){
+    if (argc < 6){
         cerr << "Número de argumentos incorrecto\n";
         // Print argc
-        cerr << "Uso: ./sim-aos-opti <num_objects> <num_iterations> <random_seed> <size_enclosure> <time_step>\n";
+        cerr << "Uso: ./sim-aos-opti <num_objects> <num_iterations> <random_seed> <size_enclosure> <time_step> [--headless] [--video=file] [--every=k] [--renderer=circles|splat]\n";
         return -1;
     }
 
@@ -58,6 +133,13 @@ int main(int argc, char const *argv[]) {
         return -2;
     }
 
+    /* Argumentos opcionales */
+    sim_options options;
+    if (!parse_options(argc, argv, &options)) {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
     /* Almacenamiento de los argumentos en sus respectivas variables */
     int num_objects = atoi(argv[1]);       // Número de objetos a simular (>0 entero)
     int num_iterations = atoi(argv[2]);    // Número de iteraciones a simular (>0 entero)
@@ -72,14 +154,6 @@ int main(int argc, char const *argv[]) {
     cout << "Scale factor: " << scale_factor << endl;
     normal_distribution<> mass_dist{M, SDM};
 
-    /* Definición de colores*/
-    std::unordered_map<int, cv::Scalar> color_map;
-    color_map[0] = cv::Scalar(0, 0, 255);    // Blue for point with ID 1
-    color_map[1] = cv::Scalar(0, 255, 0);    // Green for point with ID 2
-    color_map[2] = cv::Scalar(255, 0, 0);    // Red for point with ID 3
-    color_map[3] = cv::Scalar(0, 128, 255);  // Yellow for point with ID 4
-    color_map[4] = cv::Scalar(255, 0, 255);  // Magenta for point with ID 5
-
     /* AOS - Array of Structs */
     vector<object> objects(num_objects);
 
@@ -120,12 +194,56 @@ int main(int argc, char const *argv[]) {
             }
         }
     }
-    cv::namedWindow("Object Positions", cv::WINDOW_NORMAL);
-    cv::Mat canvas(size_enclosure/scale_factor, size_enclosure/scale_factor, CV_8UC3, cv::Scalar(255, 255, 255));  // Create a black canvas of size 'size_enclosure'
 
+    /* Hilo de pintado: la ventana (o los ficheros en modo headless) se gestionan fuera del bucle de simulación.
+       En modo headless con vídeo no hace falta */
+    render_buffer buffer;
+    bool preview = !(options.headless && !options.video.empty());
+    if (options.headless && preview) {
+        mkdir("frames", 0755);
+    }
+    thread renderer;
+    if (preview) {
+        renderer = thread(render_loop, &buffer, &options, size_enclosure, scale_factor);
+    }
+
+    /* Hilo codificador de vídeo: la simulación pinta cada 'every' iteraciones y encola el fotograma */
+    int side = size_enclosure/scale_factor;
+    frame_queue queue;
+    cv::VideoWriter writer;
+    thread encoder;
+    std::unordered_map<int, cv::Scalar> video_colors = make_color_map();
+    splat_histograms video_histograms;
+    if (!options.video.empty()) {
+        writer.open(options.video, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), VIDEO_FPS, cv::Size(side, side));
+        if (!writer.isOpened()) {
+            cerr << "No se puede abrir el fichero de vídeo " << options.video << "\n";
+            if (preview) {
+                {
+                    lock_guard<mutex> guard(buffer.lock);
+                    buffer.done = true;
+                }
+                buffer.ready.notify_one();
+                renderer.join();
+            }
+            return -3;
+        }
+        encoder = thread(encode_loop, &queue, &writer);
+    }
+    double video_start = omp_get_wtime();
+
+    /* Arena para los buffers temporales de cada iteración (se reserva una vez y se reinicia en cada iteración) */
+    arena scratch;
+    if (!arena_init(&scratch, arena_round(sizeof(vector_elem)*num_objects)))
+    {
+        cerr << "No se puede reservar la arena de los buffers temporales\n";
+        return -3;
+    }
 
     /* Iteraciones */
     for (int iteration = 0; iteration < num_iterations; iteration++) {
+        arena_reset(&scratch);
+        vector_elem *acceleration = arena_array<vector_elem>(&scratch, num_objects);
         
         /* Bucle para obtener nuevas propiedades de los objetos en la iteración (fuerzas, aceleración y velocidad) */
         for (int i = 0; i < num_objects; i++) {
@@ -135,10 +253,9 @@ int main(int argc, char const *argv[]) {
             calc_gravitational(num_objects, i, objects, forces);
             // cout << "Forces " << i << " ax: " << forces[0] << " ay: " << forces[1] << " az: " << forces[2] << "\n";
             // Cálculo del vector aceleración
-            vector_elem *acceleration = (vector_elem *)malloc(sizeof(vector_elem));
-            vector_acceleration(objects[i], forces, acceleration);
+            vector_acceleration(objects[i], forces, &acceleration[i]);
             //  Cálculo del vector velocidad
-            vector_speed(&objects[i], acceleration, time_step);
+            vector_speed(&objects[i], &acceleration[i], time_step);
         }
 
         /* Bucle para calcular posiciones y comprobar bordes */
@@ -168,53 +285,63 @@ int main(int argc, char const *argv[]) {
             }
         }
 
-        /* Limpia el canvas*/
-        canvas.setTo(cv::Scalar(255, 255, 255));
-        /* Obtiene el maximo y minimo de la masa de todos los objetos*/
-        float max_mass = 0;
-        float min_mass = 1E25;
-        for (int i = 0; i < num_objects; i++) {
-            if (objects[i].mass > max_mass) max_mass = objects[i].mass;
-            if (objects[i].mass < min_mass) min_mass = objects[i].mass;
+        /* Publica la instantánea de esta iteración para el hilo de pintado (no bloquea) */
+        if (preview) {
+            publish_snapshot(&buffer, objects, iteration);
         }
-
-        /* Bucle para pintar los objetos en el canvas */
-        for (int i = 0; i < num_objects; i++) {
-            // Calculate the position of the object on the canvas
-            int x = static_cast<int>(objects[i].pos_x/scale_factor);
-            int y = static_cast<int>(objects[i].pos_y/scale_factor);
-
-            /* En funcion el max_mass y min_mass normaliza los valores para el radio*/
-            int radius = static_cast<int>(((objects[i].mass - min_mass) / (max_mass - min_mass))*8 + 5);
-
-            // Draw a circle representing the object on the canvas
-            int color_index = objects[i].id % color_map.size();
-            cv::circle(canvas, cv::Point(x, y), radius, color_map[color_index], -1);
+        /* Fotograma del vídeo */
+        if (!options.video.empty() && iteration % options.every == 0) {
+            cv::Mat frame(side, side, CV_8UC3);
+            if (options.renderer == SPLAT) {
+                render_splat(objects, frame, scale_factor, &video_histograms);
+            } else {
+                render_frame(objects, frame, scale_factor, video_colors);
+            }
+            push_frame(&queue, frame);
         }
-        
-        // Show the canvas in the OpenCV window
-        cv::imshow("Object Positions", canvas);
-        // Wait for a key press and store the pressed key
-        int key = cv::waitKey(10);
-        // Check if the pressed key is 'Esc' (ASCII code 27)
-        if (key == 27) {
+        // Check if the 'Esc' key was pressed in the window
+        if (buffer.stop) {
             std::cout << "Esc key pressed. Exiting..." << std::endl;
-            return 0;
+            break;
         }
-        /*
-        // Save the frame as an image
-        // Create file name with leading zeros
-        std::ostringstream oss;
-        oss << std::setw(4) << std::setfill('0') << iteration;
-        std::string filename = "gif/frames/frame_" + oss.str() + ".png";
-        cv::imwrite(filename, canvas);
-        */
 
         // Actualizamos el número de objetos en el vector
         num_objects = objects.size();
         //cout << "Fin iteración: " << iteration << " Num objetos:" << num_objects << "\n";
     }
 
+    /* Terminamos el hilo de pintado cuando haya pintado el último fotograma pendiente */
+    if (preview) {
+        {
+            lock_guard<mutex> guard(buffer.lock);
+            buffer.done = true;
+        }
+        buffer.ready.notify_one();
+        renderer.join();
+        cout << "Frames: " << buffer.published << " published, " << buffer.rendered << " rendered, " << buffer.dropped << " dropped\n";
+    }
+
+    /* Terminamos el hilo codificador cuando haya vaciado la cola */
+    if (!options.video.empty()) {
+        {
+            lock_guard<mutex> guard(queue.lock);
+            queue.done = true;
+        }
+        queue.not_empty.notify_one();
+        encoder.join();
+        writer.release();
+        double video_time = omp_get_wtime() - video_start;
+        cout << "Video: " << queue.encoded << " frames in " << options.video << ", "
+             << (queue.encode_time > 0 ? queue.encoded / queue.encode_time : 0) << " fps encoding, "
+             << (video_time > 0 ? queue.encoded / video_time : 0) << " fps overall\n";
+        cout << "Video queue: max depth " << queue.max_depth << "/" << VIDEO_QUEUE << ", average depth "
+             << (queue.pushed > 0 ? (double) queue.depth_sum / queue.pushed : 0)
+             << ", simulation blocked " << queue.blocked_time << " s\n";
+    }
+    if (buffer.stop) {
+        return 0;
+    }
+
     /* Escribimos en el archivo "final_config.txt" los parámetros finales */
     ofstream file_final;
     file_final.open("final_config.txt");
@@ -225,7 +352,8 @@ int main(int argc, char const *argv[]) {
     }
 
     file_init.close(); // Cerramos el fichero "final_config.txt"
-    cv::destroyWindow("Object Positions");
+    cout<<"Peak memory: "<<peak_rss_mib()<<" MiB (scratch arena: "<<scratch.peak/1024.0<<" KiB)\n";
+    arena_free(&scratch);
 }
 
 /* FUNCIONES */
@@ -313,3 +441,269 @@ bool check_collision(object object_1, object object_2) {
     }
     return false;
 }
+
+/* Lectura de los argumentos opcionales */
+bool parse_options(int argc, char const *argv[], sim_options *options) {
+    options->renderer = CIRCLES;
+    options->headless = false;
+    options->video = "";
+    options->every = 1;
+    for (int arg = 6; arg < argc; arg++) {
+        string option = argv[arg];
+        string value = option.substr(option.find('=') + 1);
+        if (option == "--headless") {
+            options->headless = true;
+        } else if (option.rfind("--video=", 0) == 0 && !value.empty()) {
+            options->video = value;
+        } else if (option == "--renderer=circles") {
+            options->renderer = CIRCLES;
+        } else if (option == "--renderer=splat") {
+            options->renderer = SPLAT;
+        } else if (option.rfind("--every=", 0) == 0) {
+            options->every = atoi(value.c_str());
+            if (options->every <= 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Publica una instantánea de los objetos sin bloquear la simulación. Si el hilo de pintado está ocupado
+   (o no ha llegado a pintar la anterior) el fotograma se descarta */
+void publish_snapshot(render_buffer *buffer, vector<object> &objects, int iteration) {
+    buffer->published++;
+    if (buffer->rendering) {
+        buffer->dropped++;
+        return;
+    }
+
+    // slots[back] nunca lo lee el hilo de pintado, se puede copiar sin lock
+    int back = 1 - buffer->front;
+    buffer->slots[back] = objects;
+    buffer->iteration[back] = iteration;
+
+    unique_lock<mutex> guard(buffer->lock, try_to_lock);
+    if (!guard.owns_lock() || buffer->rendering) {
+        buffer->dropped++;
+        return;
+    }
+    if (buffer->fresh) {
+        buffer->dropped++; // La instantánea anterior no llegó a pintarse
+    }
+    buffer->front = back;
+    buffer->fresh = true;
+    guard.unlock();
+    buffer->ready.notify_one();
+}
+
+/* Hilo de pintado: pinta la última instantánea publicada y la muestra en la ventana o la guarda en frames/ */
+void render_loop(render_buffer *buffer, sim_options *options, double size_enclosure, float scale_factor) {
+    std::unordered_map<int, cv::Scalar> color_map = make_color_map();
+    splat_histograms histograms;
+
+    if (!options->headless) {
+        cv::namedWindow("Object Positions", cv::WINDOW_NORMAL);
+    }
+    cv::Mat canvas(size_enclosure/scale_factor, size_enclosure/scale_factor, CV_8UC3, cv::Scalar(255, 255, 255));  // Create a black canvas of size 'size_enclosure'
+
+    while (true) {
+        unique_lock<mutex> guard(buffer->lock);
+        buffer->ready.wait(guard, [buffer] { return buffer->fresh || buffer->done; });
+        if (!buffer->fresh) {
+            break; // Simulación terminada y nada pendiente
+        }
+        int slot = buffer->front;
+        buffer->fresh = false;
+        buffer->rendering = true;
+        guard.unlock();
+
+        if (options->renderer == SPLAT) {
+            render_splat(buffer->slots[slot], canvas, scale_factor, &histograms);
+        } else {
+            render_frame(buffer->slots[slot], canvas, scale_factor, color_map);
+        }
+        if (options->headless) {
+            // Save the frame as an image
+            // Create file name with leading zeros
+            std::ostringstream oss;
+            oss << std::setw(4) << std::setfill('0') << buffer->iteration[slot];
+            cv::imwrite("frames/frame_" + oss.str() + ".png", canvas);
+        } else {
+            // Show the canvas in the OpenCV window
+            cv::imshow("Object Positions", canvas);
+            // Check if the pressed key is 'Esc' (ASCII code 27)
+            if (cv::waitKey(1) == 27) {
+                buffer->stop = true;
+            }
+        }
+        buffer->rendered++;
+        buffer->rendering = false;
+    }
+
+    if (!options->headless) {
+        cv::destroyWindow("Object Positions");
+    }
+}
+
+/* Pinta los objetos de una instantánea en el canvas */
+void render_frame(vector<object> &snapshot, cv::Mat &canvas, float scale_factor, std::unordered_map<int, cv::Scalar> &color_map) {
+    /* Limpia el canvas*/
+    canvas.setTo(cv::Scalar(255, 255, 255));
+    /* Obtiene el maximo y minimo de la masa de todos los objetos*/
+    float max_mass = 0;
+    float min_mass = 1E25;
+    for (long unsigned int i = 0; i < snapshot.size(); i++) {
+        if (snapshot[i].mass > max_mass) max_mass = snapshot[i].mass;
+        if (snapshot[i].mass < min_mass) min_mass = snapshot[i].mass;
+    }
+
+    /* Bucle para pintar los objetos en el canvas */
+    for (long unsigned int i = 0; i < snapshot.size(); i++) {
+        // Calculate the position of the object on the canvas
+        int x = static_cast<int>(snapshot[i].pos_x/scale_factor);
+        int y = static_cast<int>(snapshot[i].pos_y/scale_factor);
+
+        /* En funcion el max_mass y min_mass normaliza los valores para el radio*/
+        int radius = static_cast<int>(((snapshot[i].mass - min_mass) / (max_mass - min_mass))*8 + 5);
+
+        // Draw a circle representing the object on the canvas
+        int color_index = snapshot[i].id % color_map.size();
+        cv::circle(canvas, cv::Point(x, y), radius, color_map[color_index], -1);
+    }
+}
+
+/* Definición de colores*/
+std::unordered_map<int, cv::Scalar> make_color_map() {
+    std::unordered_map<int, cv::Scalar> color_map;
+    color_map[0] = cv::Scalar(0, 0, 255);    // Blue for point with ID 1
+    color_map[1] = cv::Scalar(0, 255, 0);    // Green for point with ID 2
+    color_map[2] = cv::Scalar(255, 0, 0);    // Red for point with ID 3
+    color_map[3] = cv::Scalar(0, 128, 255);  // Yellow for point with ID 4
+    color_map[4] = cv::Scalar(255, 0, 255);  // Magenta for point with ID 5
+    return color_map;
+}
+
+/* Encola un fotograma para el codificador. Si la cola está llena espera a que haya hueco */
+void push_frame(frame_queue *queue, cv::Mat &frame) {
+    unique_lock<mutex> guard(queue->lock);
+    if (queue->frames.size() >= VIDEO_QUEUE) {
+        double start = omp_get_wtime();
+        queue->not_full.wait(guard, [queue] { return queue->frames.size() < VIDEO_QUEUE; });
+        queue->blocked_time += omp_get_wtime() - start;
+    }
+    queue->frames.push_back(frame);
+    queue->pushed++;
+    queue->depth_sum += queue->frames.size();
+    if (queue->frames.size() > queue->max_depth) {
+        queue->max_depth = queue->frames.size();
+    }
+    guard.unlock();
+    queue->not_empty.notify_one();
+}
+
+/* Hilo codificador: saca los fotogramas de la cola y los escribe en el vídeo */
+void encode_loop(frame_queue *queue, cv::VideoWriter *writer) {
+    while (true) {
+        unique_lock<mutex> guard(queue->lock);
+        queue->not_empty.wait(guard, [queue] { return !queue->frames.empty() || queue->done; });
+        if (queue->frames.empty()) {
+            break; // Simulación terminada y cola vacía
+        }
+        cv::Mat frame = queue->frames.front();
+        queue->frames.pop_front();
+        guard.unlock();
+        queue->not_full.notify_one();
+
+        double start = omp_get_wtime();
+        writer->write(frame);
+        queue->encode_time += omp_get_wtime() - start;
+        queue->encoded++;
+    }
+}
+
+/* Pinta la instantánea como un mapa de densidad. Cada hilo proyecta sus objetos en sus propios histogramas
+   de densidad y masa, se suman por píxel y se convierten a color: el brillo es log(1 + objetos) y el color
+   la masa media del píxel. El coste depende del tamaño del canvas y no del número de objetos a pintar */
+void render_splat(vector<object> &snapshot, cv::Mat &canvas, float scale_factor, splat_histograms *histograms) {
+    int rows = canvas.rows;
+    int cols = canvas.cols;
+    long pixels = (long) rows * cols;
+    long num_objects = snapshot.size();
+
+    // Reserva de los histogramas y la paleta (solo la primera vez)
+    if (histograms->threads != omp_get_max_threads() || (long) histograms->density.size() != histograms->threads * pixels) {
+        histograms->threads = omp_get_max_threads();
+        histograms->density.assign(histograms->threads * pixels, 0);
+        histograms->mass.assign(histograms->threads * pixels, 0);
+        cv::Mat ramp(1, 256, CV_8UC1);
+        for (int i = 0; i < 256; i++) {
+            ramp.at<unsigned char>(0, i) = i;
+        }
+        cv::applyColorMap(ramp, histograms->palette, cv::COLORMAP_INFERNO);
+    }
+    float *density = histograms->density.data();
+    float *mass = histograms->mass.data();
+    int threads = histograms->threads;
+
+    float max_density = 0;
+    float max_mass = 0;
+    float min_mass = 1E25;
+    #pragma omp parallel num_threads(threads)
+    {
+        /* Histogramas privados del hilo: sin atomics ni locks */
+        int thread_id = omp_get_thread_num();
+        float *my_density = density + thread_id * pixels;
+        float *my_mass = mass + thread_id * pixels;
+        fill(my_density, my_density + pixels, 0.0f);
+        fill(my_mass, my_mass + pixels, 0.0f);
+
+        #pragma omp for schedule(static)
+        for (long i = 0; i < num_objects; i++) {
+            int x = min(cols - 1, max(0, static_cast<int>(snapshot[i].pos_x/scale_factor)));
+            int y = min(rows - 1, max(0, static_cast<int>(snapshot[i].pos_y/scale_factor)));
+            my_density[(long) y * cols + x] += 1;
+            my_mass[(long) y * cols + x] += snapshot[i].mass;
+        }
+
+        /* Reducción de los histogramas en el del hilo 0 y máximos para el tone mapping */
+        #pragma omp for schedule(static) reduction(max:max_density, max_mass) reduction(min:min_mass)
+        for (long p = 0; p < pixels; p++) {
+            float total_density = density[p];
+            float total_mass = mass[p];
+            for (int t = 1; t < threads; t++) {
+                total_density += density[t * pixels + p];
+                total_mass += mass[t * pixels + p];
+            }
+            density[p] = total_density;
+            if (total_density > 0) {
+                float mean_mass = total_mass / total_density;
+                mass[p] = mean_mass;
+                max_density = max(max_density, total_density);
+                max_mass = max(max_mass, mean_mass);
+                min_mass = min(min_mass, mean_mass);
+            }
+        }
+
+        /* Tone mapping logarítmico al canvas */
+        float log_max = log1pf(max_density);
+        float mass_range = max_mass - min_mass;
+        #pragma omp for schedule(static)
+        for (int y = 0; y < rows; y++) {
+            cv::Vec3b *row = canvas.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < cols; x++) {
+                long p = (long) y * cols + x;
+                if (density[p] == 0) {
+                    row[x] = cv::Vec3b(0, 0, 0);
+                    continue;
+                }
+                float brightness = log_max > 0 ? 0.25f + 0.75f * log1pf(density[p]) / log_max : 1.0f;
+                int color_index = mass_range > 0 ? static_cast<int>((mass[p] - min_mass) / mass_range * 191) + 64 : 255;
+                cv::Vec3b color = histograms->palette.at<cv::Vec3b>(0, color_index);
+                row[x] = cv::Vec3b(static_cast<unsigned char>(color[0] * brightness), static_cast<unsigned char>(color[1] * brightness), static_cast<unsigned char>(color[2] * brightness));
+            }
+        }
+    }
+}
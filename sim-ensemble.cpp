@@ -0,0 +1,157 @@
+/* Librerias */
+#include <iostream>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "simulation.hpp"
+
+using namespace std;
+
+/* ESTRUCTURAS */
+/* Estructura trabajo: una simulación independiente del conjunto */
+struct job {
+    int random_seed;      // Semilla para distribuciones aleatorias
+    float size_enclosure; // Tamaño del recinto (>0 real)
+    float time_step;      // Incremento de tiempo en cada iteración (>0 real)
+    int num_objects;      // Número de objetos a simular (>0 entero)
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+bool read_jobs(const char *path, vector<job> &jobs);
+void run_job(job *task, int num_iterations, sim_options *options, string *result);
+
+/* MAIN */
+int main(int argc, char const *argv[])
+{
+    // Para calcular el tiempo de ejecucción
+    double start;
+    double end;
+    start = omp_get_wtime();
+    /* Comprobación inicial argumentos */
+    if (argc < 4)
+    {
+        cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./sim-ensemble <jobs_file> <num_iterations> <output_file> [opciones de sim-psoa]\n";
+        cerr << "Cada línea de <jobs_file>: <random_seed> <size_enclosure> <time_step> <num_objects>\n";
+        return -1;
+    }
+
+    /* Comprobación de valores iniciales de argumentos */
+    if (atoi(argv[2]) <= 0 || atof(argv[2]) != atoi(argv[2]))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
+    /* Argumentos opcionales (los mismos que sim-psoa) */
+    sim_options options;
+    if (!parse_options(argc, argv, 4, &options))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+    int num_iterations = atoi(argv[2]); // Número de iteraciones de cada simulación (>0 entero)
+    /* El autoajuste mide con varios hilos y comparte autotune.txt entre todos los trabajos a la vez */
+    if (options.autotune || options.replan)
+    {
+        cerr << "sim-ensemble no admite --autotune ni --replan (cada simulación usa un solo hilo)\n";
+        return -2;
+    }
+
+    /* Lectura de los trabajos */
+    vector<job> jobs;
+    if (!read_jobs(argv[1], jobs))
+    {
+        cerr << "Datos erróneos en el fichero de trabajos\n";
+        return -2;
+    }
+
+    /* Una simulación por tarea. Los trabajos tienen tamaños muy distintos, así que se reparten dinámicamente.
+       Cada simulación se ejecuta en un solo hilo: las regiones paralelas internas no se anidan */
+    omp_set_max_active_levels(1);
+    vector<string> results(jobs.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < (int)jobs.size(); k++)
+    {
+        run_job(&jobs[k], num_iterations, &options, &results[k]);
+    }
+
+    /* Un único fichero de salida con la configuración final de cada trabajo, en el orden del fichero de trabajos */
+    ofstream file_output;
+    file_output.open(argv[3]);
+    for (int k = 0; k < (int)jobs.size(); k++)
+    {
+        file_output << "# job " << k << " " << jobs[k].random_seed << "\n" << results[k];
+    }
+    file_output.close();
+
+    end = omp_get_wtime();
+    cout<<"Time: "<<end-start<<"\n";
+    cout<<"Jobs: "<<jobs.size()<<" on "<<omp_get_max_threads()<<" threads, "<<fixed<<setprecision(1)<<jobs.size()/(end-start)<<" jobs/s\n";
+}
+
+/* FUNCIONES */
+/* Lectura del fichero de trabajos: una línea por trabajo (las líneas vacías y las que empiezan por # se ignoran) */
+bool read_jobs(const char *path, vector<job> &jobs)
+{
+    ifstream file_jobs(path);
+    if (!file_jobs.is_open())
+    {
+        return false;
+    }
+    string line;
+    while (getline(file_jobs, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        istringstream fields(line);
+        string seed, size, step, objects;
+        if (!(fields >> seed >> size >> step >> objects))
+        {
+            return false;
+        }
+        // Mismas comprobaciones que los argumentos de sim-psoa
+        if ((atoi(seed.c_str()) <= 0 || atof(size.c_str()) <= 0.0 || atof(step.c_str()) <= 0.0 || atoi(objects.c_str()) <= 0) ||
+            (atof(seed.c_str()) != atoi(seed.c_str()) || atof(objects.c_str()) != atoi(objects.c_str())))
+        {
+            return false;
+        }
+        jobs.push_back({atoi(seed.c_str()), (float)atof(size.c_str()), (float)atof(step.c_str()), atoi(objects.c_str())});
+    }
+    return !jobs.empty();
+}
+
+/* Ejecuta un trabajo y deja su configuración final (mismo formato que final_config.txt de sim-psoa) en result */
+void run_job(job *task, int num_iterations, sim_options *options, string *result)
+{
+    // Un solo hilo por simulación: step() fija el número de hilos del hilo del trabajo, así las regiones internas
+    // (y los tramos que reparten por hilo) no cuentan con hilos que no se anidan
+    sim_options job_options = *options;
+    job_options.threads = 1;
+    Simulation simulation(task->num_objects, task->random_seed, task->size_enclosure, task->time_step, job_options);
+    simulation.step(num_iterations);
+
+    ostringstream output;
+    output << fixed << setprecision(3) << task->size_enclosure << " " << task->time_step << " " << simulation.created() << "\n";
+
+    // Los objetos se escriben en orden de creación aunque se hayan reordenado
+    vector<int> position(simulation.created(), -1);
+    for (int i = 0; i < simulation.count(); i++)
+    {
+        position[simulation.ids()[i]] = i;
+    }
+    for (int k = 0; k < simulation.created(); k++)
+    {
+        int i = position[k];
+        if(i >= 0){
+            output << simulation.pos_x()[i] << " " << simulation.pos_y()[i] << " " << simulation.pos_z()[i] << " " << simulation.speed_x()[i] << " " << simulation.speed_y()[i] << " " << simulation.speed_z()[i] << " " << simulation.masses()[i] << "\n";
+        }
+    }
+    *result = output.str();
+}
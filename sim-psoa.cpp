@@ -2,47 +2,62 @@
 #include <iostream>
 #include <math.h>
 #include <fstream>
-#include <random>
-#include <vector>
 #include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <omp.h>
+#include <sys/stat.h>
+#include "simulation.hpp"
+#include "codec.hpp"
 
 using namespace std;
 
-/* CONSTANTES */
-const double GRAVITY_CONST = 6.674 * 1E-11; // Constante gravedad universal
-const double M = 1E21;                      // Media (distribución normal)
-const double SDM = 1E15;                    // Desviación (distribución normal)
-
 /* ESTRUCTURAS */
-/* Estructura objeto */
-struct object {
-    double *pos_x;
-    double *pos_y;
-    double *pos_z;
-    double *speed_x;
-    double *speed_y;
-    double *speed_z;
-    double *mass;
-    bool *active;
+/* Estructura snapshot: copia inmutable del estado para escribirla en un fichero (formato de final_config.txt,
+   o comprimido con codec.hpp si compress > 0) */
+struct snapshot {
+    string path;
+    float size_enclosure;
+    float time_step;
+    double compress;               // Cota de error relativa del códec (0: texto)
+    int iteration;
+    int created;                   // Objetos creados (los ids van de 0 a created - 1)
+    vector<double> pos_x, pos_y, pos_z, speed_x, speed_y, speed_z, mass;
+    vector<int> id;
 };
 
-/* Estructura vector_elem */
-struct vector_elem{
-    double x;
-    double y;
-    double z;
+/* Estructura output_queue: cola acotada entre la simulación y el hilo de escritura. La simulación copia el
+   estado y sigue iterando mientras el hilo da formato y escribe; si la cola está llena la simulación espera */
+struct output_queue {
+    deque<snapshot> snapshots;
+    size_t capacity;               // Instantáneas máximas en la cola (--output-queue)
+    bool done = false;             // La simulación ha terminado
+    mutex lock;
+    condition_variable not_empty;
+    condition_variable not_full;
+    long pushed = 0;               // Estadísticas
+    long written = 0;
+    long bytes = 0;
+    size_t max_depth = 0;
+    double blocked_time = 0;       // Tiempo que la simulación ha esperado con la cola llena
+    double write_time = 0;         // Tiempo del hilo de escritura dando formato y escribiendo
+    codec_state codec;             // Instantánea anterior del códec (solo la usa el hilo de escritura)
+    long compressed = 0;           // Instantáneas comprimidas, sus bytes y los de sus columnas sin comprimir
+    long compressed_bytes = 0;
+    long raw_bytes = 0;
 };
 
 /* DECLARACIÓN PREVIA DE FUNCIONES */
-double euclidean_norm(object objects, int index_1, int index_2);
-void vector_gravitational_force(object objects, int index_1, int index_2, vector_elem* forces);
-void calc_gravitational(int num_objects, int k, object objects, vector_elem* forces);
-void vector_acceleration(object objects, int i, vector_elem* forces, vector_elem* acceleration);
-void vector_speed(object *objects, int i, vector_elem *acceleration, double time_step);
-void vector_position(object *objects, int i, double time_step);
-void check_border(object *objects, int i, double size_enclosure);
-bool check_collision(object objects, int i, int j);
+void take_snapshot(Simulation *simulation, string path, float size_enclosure, float time_step, double compress, snapshot *copy);
+void push_snapshot(output_queue *queue, snapshot &copy);
+void write_loop(output_queue *queue);
+void write_snapshot(snapshot *copy, output_queue *queue);
+void write_compressed(snapshot *copy, output_queue *queue);
 
 /* MAIN */
 int main(int argc, char const *argv[])
@@ -56,9 +71,10 @@ int main(int argc, char const *argv[])
     double end;
     start = omp_get_wtime();
     /* Comprobación inicial argumentos */
-    if (argc != 6)
+    if (argc < 6)
     {
         cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./sim-psoa <num_objects> <num_iterations> <random_seed> <size_enclosure> <time_step> [--integrator=euler|leapfrog|block] [--block-levels=L] [--block-eta=D] [--collision=all|verlet] [--skin=S] [--force=direct|cutoff|pm] [--cutoff=R] [--softening=E] [--pm-grid=G] [--morton=K] [--energy] [--monitor=K] [--threads=T] [--tile=B] [--autotune] [--replan] [--output-every=K] [--output-queue=Q] [--compress=E] [--backend=openmp|std|pool] [--reproducible] [--rsqrt=1|2]\n";
         return -1;
     }
 
@@ -70,6 +86,14 @@ int main(int argc, char const *argv[])
         return -2;
     }
 
+    /* Argumentos opcionales */
+    sim_options options;
+    if (!parse_options(argc, argv, 6, &options))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
     /* Almacenamiento de los argumentos en sus respectivas variables */
     int num_objects = atoi(argv[1]);      // Número de objetos a simular (>0 entero)
     int num_iterations = atoi(argv[2]);   // Número de iteraciones a simular (>0 entero)
@@ -77,299 +101,271 @@ int main(int argc, char const *argv[])
     float size_enclosure = atof(argv[4]); // Tamaño del recinto (>0 real)
     float time_step = atof(argv[5]);      // Incremento de tiempo en cada iteración (>0 real)
 
-    /* SOA - Structure of Arrays */
-    object objects; 
-    objects.mass = (double*)malloc(sizeof(double)*num_objects);
-    objects.pos_x  = (double*)malloc(sizeof(double)*num_objects);
-    objects.pos_y  = (double*)malloc(sizeof(double)*num_objects);
-    objects.pos_z  = (double*)malloc(sizeof(double)*num_objects);
-    objects.speed_x  = (double*)malloc(sizeof(double)*num_objects);
-    objects.speed_y = (double*)malloc(sizeof(double)*num_objects);
-    objects.speed_z = (double*)malloc(sizeof(double)*num_objects);
-    objects.active = (bool*)malloc(sizeof(bool)*num_objects);
+    /* Simulación (biblioteca simulation.hpp) */
+    Simulation simulation(num_objects, random_seed, size_enclosure, time_step, options);
 
-    /* Coordenadas y masas pseudoaleatorias */
-    mt19937_64 gen(random_seed);
-    uniform_real_distribution<double> position_dist(0.0, nextafter(size_enclosure, numeric_limits<double>::max()));
-    normal_distribution<double> mass_dist(M, SDM);
+    /* Hilo de escritura: los ficheros se escriben mientras la simulación sigue iterando */
+    output_queue queue;
+    queue.capacity = options.output_queue;
+    thread writer(write_loop, &queue);
+    if (options.output_every > 0)
+    {
+        mkdir("snapshots", 0755);
+    }
 
     /* Fichero de configuracion inicial */
-    ofstream file_init;
-    file_init.open("init_config.txt");
-    file_init << fixed << setprecision(3) << size_enclosure << " " << time_step << " " << num_objects << endl;
+    snapshot copy;
+    take_snapshot(&simulation, "init_config.txt", size_enclosure, time_step, 0.0, &copy);
+    push_snapshot(&queue, copy);
 
-    /* Creación de objetos */
-    for (int i = 0; i < num_objects; i++)
+    /* Plan de ejecución medido sobre los objetos generados (o el guardado en "autotune.txt" para esta máquina) */
+    if (options.autotune)
     {
-        objects.pos_x[i] = position_dist(gen); // Posicion x, y, z
-        objects.pos_y[i] = position_dist(gen);
-        objects.pos_z[i] = position_dist(gen);
-        objects.mass[i] = mass_dist(gen); // Masa
-        objects.active[i] = true; // Active
-
-        // Ponemos la precisión a 3 decimales. Imprimimos el objeto
-        file_init << fixed << setprecision(3) << objects.pos_x[i] << " " << objects.pos_y[i] << " " << objects.pos_z[i] << " " << objects.speed_x[i] << " " << objects.speed_y[i] << " " << objects.speed_z[i] << " " << objects.mass[i] << endl;
+        bool cached;
+        double seconds;
+        execution_plan plan = autotune(&simulation, AUTOTUNE_FILE, &cached, &seconds);
+        simulation.set_plan(plan);
+        cout<<"Auto-tune: "<<(cached ? "cached" : "measured")<<" plan for "<<simulation.count()<<" objects in "<<fixed<<setprecision(3)<<seconds<<" s: threads "<<plan.threads
+            <<", tile "<<plan.tile<<", collision "<<(plan.collision == VERLET ? "verlet" : "all")<<"\n";
     }
 
-    file_init.close(); // Cerramos el fichero "init_config.txt"
-
-
-    /* Bucle anidado para comprobar colisiones entre objetos previas a las iteraciones */
-    #pragma omp parallel for
-    for (int i = 0; i < num_objects; i++)
+    /* Iteraciones, con una instantánea cada output_every iteraciones en snapshots/ (.snap con --compress) */
+    int block = options.output_every > 0 ? options.output_every : num_iterations;
+    for (int done = 0; done < num_iterations; done += block)
     {
-        for (int j = i + 1; j < num_objects; j++)
+        simulation.step(min(block, num_iterations - done));
+        if (options.output_every > 0 && done + block < num_iterations)
         {
-            // Comprobar colisiones
-            if(objects.active[i]==true && objects.active[j]==true){
-            // Colision entre objetos diferentes que no hayan sido eliminados con anterioridad
-                if (check_collision(objects, i, j))
-                {   
-                    // Comprobar colisión
-                    // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
-                    // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
-                    objects.mass[i] += objects.mass[j];
-                    objects.speed_x[i] += objects.speed_x[j];
-                    objects.speed_y[i] += objects.speed_y[j];
-                    objects.speed_z[i] += objects.speed_z[j];
-                    
-                    // Se "elimina" el objeto
-                    objects.active[j]=false;
-                }
-            }
+            ostringstream path;
+            path << "snapshots/snapshot_" << setw(6) << setfill('0') << simulation.iteration() << (options.compress > 0 ? ".snap" : ".txt");
+            take_snapshot(&simulation, path.str(), size_enclosure, time_step, options.compress, &copy);
+            push_snapshot(&queue, copy);
         }
     }
 
-    /* Iteraciones */
-    for (int iteration = 0; iteration < num_iterations; iteration++)
+    /* Escribimos en el archivo "final_config.txt" los parámetros finales y esperamos a que se escriba todo */
+    take_snapshot(&simulation, "final_config.txt", size_enclosure, time_step, 0.0, &copy);
+    push_snapshot(&queue, copy);
     {
-        struct vector_elem *acceleration = (vector_elem*)malloc(sizeof(vector_elem)*num_objects);
-        struct vector_elem *forces = (vector_elem*)malloc(sizeof(vector_elem)*num_objects);
-        /* Bucle para obtener nuevas propiedades de los objetos en la iteración (fuerzas)*/
-        for (int i = 0; i < num_objects; i++)
-        {
-            if(objects.active[i]==true){
-                // Solo entrarán en el condicional objetos que no se han eliminado
-                // Cálculo de la fuerza gravitatoria
-                calc_gravitational(num_objects, i, objects, &forces[i]);
-            }
-        }
-        /* Bucle para obtener nuevas propiedades de los objetos en la iteración (aceleracion)*/
-        for (int i = 0; i < num_objects; i++)
-        {
-            if(objects.active[i]==true){
-                // Solo entrarán en el condicional objetos que no se han eliminado
-                // Cálculo del vector aceleración
-                vector_acceleration(objects, i, &forces[i], &acceleration[i]);
-            }
-        }
-        /* Bucle para obtener nuevas propiedades de los objetos en la iteración (velocidad)*/
-        for (int i = 0; i < num_objects; i++)
-        {
-            if(objects.active[i]==true){
-                // Solo entrarán en el condicional objetos que no se han eliminado
-                //  Cálculo del vector velocidad
-                vector_speed(&objects, i, &acceleration[i], time_step);
-            }
-        }
+        lock_guard<mutex> guard(queue.lock);
+        queue.done = true;
+    }
+    queue.not_empty.notify_one();
+    writer.join();
 
-        /* Bucle para calcular posiciones*/        
-        for (int i = 0; i < num_objects; i++)
-        {
-            if(objects.active[i]==true){
-                // Solo entrarán en el condicional objetos que no se han eliminado
-                // Cálculo del vector posiciones
-                vector_position(&objects, i, time_step);
-            }
-        }
+    end = omp_get_wtime();
+    cout<<"Time: "<<end-start<<"\n";
+
+    cout<<"Peak memory: "<<peak_rss_mib()<<" MiB (arenas: "<<simulation.arena_peak()/1024.0<<" KiB)\n";
 
-        /* Bucle para comprobar bordes */        
-        for (int i = 0; i < num_objects; i++)
+    /* Deriva relativa de la energía total (las fusiones por colisión no conservan la energía) */
+    if (options.energy)
+    {
+        cout<<"Energy drift: "<<scientific<<simulation.energy_drift()<<"\n";
+    }
+
+    /* Monitor de cantidades conservadas: una fila por muestra en "monitor.txt" */
+    if (options.monitor > 0)
+    {
+        ofstream file_monitor;
+        file_monitor.open("monitor.txt");
+        file_monitor << "# iteration kinetic potential total momentum_x momentum_y momentum_z angular_x angular_y angular_z\n";
+        double first_total = NAN;
+        double last_total = NAN;
+        for (const monitor_sample &sample : simulation.monitor())
         {
-            if(objects.active[i]==true){
-                // Solo entrarán en el condicional objetos que no se han eliminado
-                //  Comprobar bordes
-                check_border(&objects, i, size_enclosure);
+            file_monitor << sample.iteration << " " << scientific << setprecision(10) << sample.kinetic << " ";
+            if (isnan(sample.potential))
+            {
+                // Potencial solo cada options.monitor iteraciones
+                file_monitor << "- - ";
             }
-        }
-        /* Bucle anidado para comprobar colisiones entre objetos previas a las iteraciones */
-        #pragma omp parallel for
-        for (int i = 0; i < num_objects; i++)
-        {
-            for (int j = i + 1; j < num_objects; j++)
+            else
             {
-                // Comprobar colisiones
-                if(objects.active[i]==true && objects.active[j]==true){
-                // Colision entre objetos diferentes que no hayan sido eliminados con anterioridad
-                    if (check_collision(objects, i, j))
-                    {   
-                        // Comprobar colisión
-                        // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
-                        // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
-                        objects.mass[i] += objects.mass[j];
-                        objects.speed_x[i] += objects.speed_x[j];
-                        objects.speed_y[i] += objects.speed_y[j];
-                        objects.speed_z[i] += objects.speed_z[j];
-                        
-                        // Se "elimina" el objeto
-                        objects.active[j]=false;
-                    }
-                }
+                double total = sample.kinetic + sample.potential;
+                file_monitor << sample.potential << " " << total << " ";
+                first_total = isnan(first_total) ? total : first_total;
+                last_total = total;
             }
+            file_monitor << sample.momentum.x << " " << sample.momentum.y << " " << sample.momentum.z << " "
+                         << sample.angular.x << " " << sample.angular.y << " " << sample.angular.z << "\n";
         }
+        file_monitor.close();
+        cout<<"Monitor: "<<simulation.monitor().size()<<" samples, energy drift "<<scientific<<setprecision(6)<<(last_total - first_total) / fabs(first_total)
+            <<", overhead "<<fixed<<setprecision(2)<<100 * simulation.monitor_overhead()<<"% of step time\n";
     }
 
-    /* Escribimos en el archivo "final_config.txt" los parámetros finales */
-    ofstream file_final;
-    file_final.open("final_config.txt");
-    file_final << fixed << setprecision(3) << size_enclosure << " " << time_step << " " << num_objects << endl;
+    /* Cambios del plan de ejecución al reducirse el número de objetos */
+    for (const plan_change &change : simulation.plan_changes())
+    {
+        cout<<"Re-plan: iteration "<<change.iteration<<", "<<change.objects<<" objects, "<<(change.cached ? "cached" : "measured")<<" in "<<fixed<<setprecision(3)<<change.seconds
+            <<" s: threads "<<change.plan.threads<<", tile "<<change.plan.tile<<", collision "<<(change.plan.collision == VERLET ? "verlet" : "all")<<"\n";
+    }
 
-    for (int i = 0; i < num_objects; i++)
+    /* Estadísticas de las listas de vecinos */
+    const neighbour_list &list = simulation.neighbours();
+    if (options.collision == VERLET)
     {
-        if(objects.active[i]==true){
-            file_final << fixed << setprecision(3) << objects.pos_x[i] << " " << objects.pos_y[i] << " " << objects.pos_z[i] << " " << objects.speed_x[i] << " " << objects.speed_y[i] << " " << objects.speed_z[i] << " " << objects.mass[i] << endl;
-        }
+        cout<<"Neighbour lists: "<<list.rebuilds<<" rebuilds in "<<list.passes<<" passes, average length "
+            <<fixed<<setprecision(2)<<(double)list.total_length/max(list.total_objects, 1L)<<"\n";
     }
 
-    file_init.close(); // Cerramos el fichero "final_config.txt"
-    end = omp_get_wtime();
-    cout<<"Time: "<<end-start<<"\n";
-}
-/* FUNCIONES */
-/* Distancia euclídea entre dos objetos */
-double euclidean_norm(object objects, int i, int j)
-{
-    return std::sqrt((objects.pos_x[i]- objects.pos_x[j]) * (objects.pos_x[i]- objects.pos_x[j]) + (objects.pos_y[i]- objects.pos_y[j]) * (objects.pos_y[i]- objects.pos_y[j]) + (objects.pos_z[i]- objects.pos_z[j]) * (objects.pos_z[i]- objects.pos_z[j]));
-}
+    /* Pasadas de colisiones con todos los pares que la planificación ha podido saltar */
+    const collision_schedule &schedule = simulation.collisions();
+    if (schedule.passes > 0)
+    {
+        cout<<"Collision passes: "<<schedule.skipped<<" of "<<schedule.passes<<" skipped (no pair could reach distance 1)\n";
+    }
 
-/* Fuerza gravitatoria entre dos objetos */
-void vector_gravitational_force(object objects, int i, int j, vector_elem *forces)
-{
-    double dist = euclidean_norm(objects, i, j);
-    double Fg = GRAVITY_CONST * objects.mass[i] * objects.mass[j]/ (dist*dist*dist);
-    forces->x += (Fg * (objects.pos_x[i] - objects.pos_x[j]));
-    forces->y += (Fg * (objects.pos_y[i] - objects.pos_y[j]));
-    forces->z += (Fg * (objects.pos_z[i] - objects.pos_z[j]));
-}
+    /* Coste de los pasos por bloques frente a leapfrog con el mismo time_step (una evaluación por iteración) */
+    if (options.integrator == BLOCK)
+    {
+        cout<<"Force evaluations: "<<simulation.force_evaluations()<<" ("<<fixed<<setprecision(2)<<(double)simulation.force_evaluations()/max(simulation.global_force_evaluations(), 1L)
+            <<"x leapfrog with time_step: "<<simulation.global_force_evaluations()<<")\n";
+    }
 
-/* Fuerza gravitatoria que ejerce un objeto */
-void calc_gravitational(int num_objects, int i, object objects, vector_elem *forces){
-    for (int j = 0; j < num_objects; j++){
-        if (j != i && objects.active[j]==true){
-            vector_gravitational_force(objects, j, i, forces);
-        }
+    /* Estadísticas del hilo de escritura: tiempo escribiendo y tiempo que la simulación ha esperado por la cola */
+    cout<<"Output: "<<queue.written<<" files, "<<fixed<<setprecision(2)<<queue.bytes/(1024.0*1024.0)<<" MiB in "<<setprecision(3)<<queue.write_time<<" s (writer thread), "
+        <<"blocked "<<queue.blocked_time<<" s, max queue depth "<<queue.max_depth<<"/"<<queue.capacity<<"\n";
+
+    /* Instantáneas comprimidas: tamaño frente a las columnas sin comprimir (7 doubles y el id por objeto) */
+    if (queue.compressed > 0)
+    {
+        cout<<"Compressed snapshots: "<<queue.compressed<<" files, "<<fixed<<setprecision(2)<<queue.compressed_bytes/(1024.0*1024.0)<<" MiB, "
+            <<setprecision(1)<<(double)queue.raw_bytes/queue.compressed_bytes<<"x smaller than the raw columns, error bound "<<scientific<<setprecision(1)<<options.compress<<"\n";
     }
 }
 
-/* Vector aceleración */
-void vector_acceleration(object objects, int i, vector_elem *forces, vector_elem *acceleration)
+/* FUNCIONES */
+/* Copia del estado actual de la simulación para escribirla en path (comprimida si compress > 0) */
+void take_snapshot(Simulation *simulation, string path, float size_enclosure, float time_step, double compress, snapshot *copy)
 {
-    /* Cálculo del vector aceleración */
-    acceleration->x = forces->x / objects.mass[i];
-    acceleration->y = forces->y/ objects.mass[i];
-    acceleration->z = forces->z / objects.mass[i];
+    copy->path = path;
+    copy->size_enclosure = size_enclosure;
+    copy->time_step = time_step;
+    copy->compress = compress;
+    copy->iteration = simulation->iteration();
+    copy->created = simulation->created();
+    copy->pos_x.assign(simulation->pos_x().begin(), simulation->pos_x().end());
+    copy->pos_y.assign(simulation->pos_y().begin(), simulation->pos_y().end());
+    copy->pos_z.assign(simulation->pos_z().begin(), simulation->pos_z().end());
+    copy->speed_x.assign(simulation->speed_x().begin(), simulation->speed_x().end());
+    copy->speed_y.assign(simulation->speed_y().begin(), simulation->speed_y().end());
+    copy->speed_z.assign(simulation->speed_z().begin(), simulation->speed_z().end());
+    copy->mass.assign(simulation->masses().begin(), simulation->masses().end());
+    copy->id.assign(simulation->ids().begin(), simulation->ids().end());
 }
 
-/* Vector velocidad */
-void vector_speed(object *objects, int i, vector_elem *acceleration, double time_step)
+/* Encola una instantánea para el hilo de escritura (la mueve, copy queda vacía). Si la cola está llena espera */
+void push_snapshot(output_queue *queue, snapshot &copy)
 {
-    /* Cálculo del vector velocidad */
-    objects->speed_x[i] += (acceleration->x * time_step);
-    objects->speed_z[i] += (acceleration->z * time_step);
-    objects->speed_y[i] += (acceleration->y * time_step);
-    
-    /* 
-    //Version que usa sections
-    #pragma omp parallel
+    unique_lock<mutex> guard(queue->lock);
+    if (queue->snapshots.size() >= queue->capacity)
     {
-        #pragma omp sections
-        {
-            #pragma omp section
-                objects->speed_x[i] += (acceleration->x * time_step);
-
-            #pragma omp section
-                objects->speed_z[i] += (acceleration->z * time_step);
-
-            #pragma omp section
-                objects->speed_y[i] += (acceleration->y * time_step);
-        }
+        double start = omp_get_wtime();
+        queue->not_full.wait(guard, [queue] { return queue->snapshots.size() < queue->capacity; });
+        queue->blocked_time += omp_get_wtime() - start;
     }
-    */
-
+    queue->snapshots.push_back(std::move(copy));
+    queue->pushed++;
+    if (queue->snapshots.size() > queue->max_depth)
+    {
+        queue->max_depth = queue->snapshots.size();
+    }
+    guard.unlock();
+    queue->not_empty.notify_one();
 }
 
-/* Vector de posicion */
-void vector_position(object *objects, int i, double time_step)
+/* Hilo de escritura: saca las instantáneas de la cola y las escribe */
+void write_loop(output_queue *queue)
 {
-    /* Cálculo del vector posición */
-    objects->pos_x[i] += (objects->speed_x[i] * time_step);
-    objects->pos_y[i] += (objects->speed_y[i] * time_step);
-    objects->pos_z[i] += (objects->speed_z[i] * time_step);
-    /*
-    // Version que usa sections 
-    #pragma omp parallel
+    while (true)
     {
-        #pragma omp sections
+        unique_lock<mutex> guard(queue->lock);
+        queue->not_empty.wait(guard, [queue] { return !queue->snapshots.empty() || queue->done; });
+        if (queue->snapshots.empty())
         {
-            #pragma omp section
-                objects->pos_x[i] += (objects->speed_x[i] * time_step);
-
-            #pragma omp section
-                objects->pos_y[i] += (objects->speed_y[i] * time_step);
+            break; // Simulación terminada y cola vacía
+        }
+        snapshot copy = std::move(queue->snapshots.front());
+        queue->snapshots.pop_front();
+        guard.unlock();
+        queue->not_full.notify_one();
 
-            #pragma omp section
-                objects->pos_z[i] += (objects->speed_z[i] * time_step);
+        double start = omp_get_wtime();
+        if (copy.compress > 0)
+        {
+            write_compressed(&copy, queue);
+        }
+        else
+        {
+            write_snapshot(&copy, queue);
         }
+        queue->write_time += omp_get_wtime() - start;
+        queue->written++;
     }
-    */
 }
 
-/* Función para recolocar al objeto si traspasa los límites */
-void check_border(object *objects, int i, double size_enclosure)
+/* Escribe una instantánea: cabecera y objetos en orden de creación aunque se hayan reordenado */
+void write_snapshot(snapshot *copy, output_queue *queue)
 {
-    // Checks posición x
-    if (objects->pos_x[i] <= 0)
-    {
-        objects->pos_x[i] = 0;
-        objects->speed_x[i] = -1 * (objects->speed_x[i]);
-    }
-    else if (objects->pos_x[i] >= size_enclosure)
-    {
-        objects->pos_x[i] = size_enclosure;
-        objects->speed_x[i] = -1 * (objects->speed_x[i]);
-    }
-
-    // Checks posición y
-    if (objects->pos_y[i] <= 0)
+    ostringstream output;
+    output << fixed << setprecision(3) << copy->size_enclosure << " " << copy->time_step << " " << copy->created << "\n";
+    vector<int> position(copy->created, -1);
+    for (int i = 0; i < (int)copy->id.size(); i++)
     {
-        objects->pos_y[i] = 0;
-        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+        position[copy->id[i]] = i;
     }
-    else if (objects->pos_y[i] >= size_enclosure)
+    for (int k = 0; k < copy->created; k++)
     {
-        objects->pos_y[i] = size_enclosure;
-        objects->speed_y[i] = -1 * (objects->speed_y[i]);
-    }
-
-    // Checks posición z
-    if (objects->pos_z[i] <= 0)
-    {
-        objects->pos_z[i] = 0;
-        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+        int i = position[k];
+        if(i >= 0){
+            // Ponemos la precisión a 3 decimales. Imprimimos el objeto
+            output << copy->pos_x[i] << " " << copy->pos_y[i] << " " << copy->pos_z[i] << " " << copy->speed_x[i] << " " << copy->speed_y[i] << " " << copy->speed_z[i] << " " << copy->mass[i] << "\n";
+        }
     }
-    else if (objects->pos_z[i] >= size_enclosure)
-    {
-        objects->pos_z[i] = size_enclosure;
-        objects->speed_z[i] = -1 * (objects->speed_z[i]);
-    }      
+    string text = output.str();
+    ofstream file_output;
+    file_output.open(copy->path);
+    file_output << text;
+    file_output.close();
+    queue->bytes += text.size();
 }
 
-/* Comprobar colisión entre dos objetos (distancia euclídea entre objetos menor que 1) */
-bool check_collision(object objects, int i, int j)
+/* Escribe una instantánea comprimida con codec.hpp, con los objetos en orden de creación. Las diferencias son
+   respecto a la anterior instantánea comprimida, así que se tienen que escribir en orden (un solo hilo) */
+void write_compressed(snapshot *copy, output_queue *queue)
 {
-    if (euclidean_norm(objects, i, j) < 1)
+    codec_frame frame;
+    frame.size_enclosure = copy->size_enclosure;
+    frame.time_step = copy->time_step;
+    frame.iteration = copy->iteration;
+    frame.created = copy->created;
+    vector<int> position(copy->created, -1);
+    for (int i = 0; i < (int)copy->id.size(); i++)
     {
-        return true;
+        position[copy->id[i]] = i;
+    }
+    const vector<double> *columns[CODEC_COLUMNS] = {&copy->pos_x, &copy->pos_y, &copy->pos_z, &copy->speed_x, &copy->speed_y, &copy->speed_z, &copy->mass};
+    for (int k = 0; k < copy->created; k++)
+    {
+        int i = position[k];
+        if(i >= 0){
+            frame.id.push_back(k);
+            for (int c = 0; c < CODEC_COLUMNS; c++)
+            {
+                frame.column[c].push_back((*columns[c])[i]);
+            }
+        }
     }
-    return false;
+    string bytes;
+    codec_encode(&frame, copy->compress, &queue->codec, &bytes);
+    ofstream file_output;
+    file_output.open(copy->path, ios::binary);
+    file_output << bytes;
+    file_output.close();
+    queue->bytes += bytes.size();
+    queue->compressed++;
+    queue->compressed_bytes += bytes.size();
+    queue->raw_bytes += frame.id.size() * (CODEC_COLUMNS * sizeof(double) + sizeof(int));
 }
@@ -0,0 +1,597 @@
+/* Librerias */
+#include <iostream>
+#include <math.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.hpp"
+
+using namespace std;
+
+/* CONSTANTES */
+const double GRAVITY_CONST = 6.674 * pow(10, -11); // Constante gravedad universal
+const double M = pow(10, 21);                      // Media (distribución normal)
+const double SDM = pow(10, 15);                    // Desviación (distribución normal)
+const int DEFAULT_TILE = 65536;                    // Objetos por bloque si no se indica tile
+
+/* ESTRUCTURAS */
+/* Estructura objeto: las columnas SOA de sim-soa-opti.cpp, proyectadas desde ficheros (mmap). Los objetos
+   fusionados se marcan con active en vez de borrarse, así las columnas no se mueven en el disco */
+struct object {
+    double *pos_x;
+    double *pos_y;
+    double *pos_z;
+    double *speed_x;
+    double *speed_y;
+    double *speed_z;
+    double *mass;
+    bool *active;
+};
+
+/* Columnas en ficheros (índices de columns) */
+enum column_index {POS_X, POS_Y, POS_Z, SPEED_X, SPEED_Y, SPEED_Z, MASS, ACTIVE, NUM_COLUMNS};
+
+/* Estructura columna en fichero */
+struct column_file {
+    const char *name;
+    size_t element;     // Bytes por objeto
+    void *data;         // Proyección compartida del fichero
+    size_t bytes;
+    int fd;
+};
+
+/* Estructura bloque residente: copia en memoria de las posiciones, masas y estado de un bloque. Las pasadas
+   tienen dos: el bloque i y el bloque j que se lee de los ficheros y se recorre contra él */
+struct resident_tile {
+    double *pos_x;
+    double *pos_y;
+    double *pos_z;
+    double *mass;
+    bool *active;
+};
+
+/* Estructura vector_elem */
+struct vector_elem{
+    double x;
+    double y;
+    double z;
+};
+
+/* Estructura contadores de E/S del proceso (/proc/self/io) */
+struct io_counters {
+    long read_bytes;    // Bytes leídos del dispositivo (fallos de página que no estaban en la caché)
+    long write_bytes;   // Bytes de páginas modificadas que se escriben al dispositivo
+};
+
+/* Columnas que recorre cada pasada */
+const int FORCE_COLUMNS[] = {POS_X, POS_Y, POS_Z, MASS, ACTIVE};
+const int POSITION_COLUMNS[] = {POS_X, POS_Y, POS_Z, SPEED_X, SPEED_Y, SPEED_Z, ACTIVE};
+const int COLLISION_COLUMNS[] = {POS_X, POS_Y, POS_Z, ACTIVE};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+bool map_column(const string &dir, column_file *column, int num_objects);
+void unmap_column(column_file *column);
+void prefetch_tile(column_file *columns, const int *which, int count, long first, long n);
+size_t tile_bytes(column_file *columns, const int *which, int count, long n);
+io_counters read_io_counters();
+void load_tile(object objects, long first, long n, resident_tile *tile);
+double euclidean_norm(resident_tile *source, long m, resident_tile *tile, long k);
+void vector_gravitational_force(resident_tile *source, long m, resident_tile *tile, long k, vector_elem *forces);
+void vector_acceleration(resident_tile *tile, long k, vector_elem *forces, vector_elem *acceleration);
+void vector_speed(object *objects, long i, vector_elem *acceleration, double time_step);
+void vector_position(object *objects, long i, double time_step);
+void check_border(object *objects, long i, double size_enclosure);
+bool check_collision(resident_tile *source, long m, resident_tile *tile, long k);
+void merge_objects(object objects, long i, long j);
+size_t force_pass(int num_objects, object objects, column_file *columns, int tile_size, resident_tile *tile, resident_tile *source, vector_elem *forces, double time_step);
+size_t position_pass(int num_objects, object objects, column_file *columns, int tile_size, double time_step, double size_enclosure);
+size_t collision_pass(int num_objects, object objects, column_file *columns, int tile_size, resident_tile *tile, resident_tile *source);
+
+/* MAIN */
+int main(int argc, char const *argv[])
+{
+
+    /* Comprobación inicial argumentos */
+    if (argc < 6 || argc > 8)
+    {
+        cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./sim-soa-ooc <num_objects> <num_iterations> <random_seed> <size_enclosure> <time_step> [storage_dir] [tile]\n";
+        return -1;
+    }
+
+    /* Comprobación de valores iniciales de argumentos */
+    if ((atoi(argv[1]) <= 0 || atoi(argv[2]) <= 0 || atoi(argv[3]) <= 0 || atof(argv[4]) <= 0.0 || atof(argv[5]) <= 0.0) ||
+        (atof(argv[1]) != atoi(argv[1]) || atof(argv[2]) != atoi(argv[2]) || atof(argv[3]) != atoi(argv[3])) ||
+        (argc > 7 && (atoi(argv[7]) <= 0 || atof(argv[7]) != atoi(argv[7]))))
+    {
+        cerr << "Datos erróneos de los argumentos\n";
+        return -2;
+    }
+
+    /* Almacenamiento de los argumentos en sus respectivas variables */
+    int num_objects = atoi(argv[1]);      // Número de objetos a simular (>0 entero)
+    int num_iterations = atoi(argv[2]);   // Número de iteraciones a simular (>0 entero)
+    int random_seed = atoi(argv[3]);      // Semilla para distribuciones aleatorias
+    float size_enclosure = atof(argv[4]); // Tamaño del recinto (>0 real)
+    float time_step = atof(argv[5]);      // Incremento de tiempo en cada iteración (>0 real)
+    string storage_dir = argc > 6 ? argv[6] : ".";             // Directorio de los ficheros de las columnas (NVMe local)
+    int tile_size = argc > 7 ? atoi(argv[7]) : DEFAULT_TILE;  // Objetos por bloque
+    tile_size = min(tile_size, num_objects);
+
+    /* SOA en ficheros: una columna por fichero */
+    column_file columns[NUM_COLUMNS] = {
+        {"pos_x", sizeof(double), NULL, 0, -1}, {"pos_y", sizeof(double), NULL, 0, -1}, {"pos_z", sizeof(double), NULL, 0, -1},
+        {"speed_x", sizeof(double), NULL, 0, -1}, {"speed_y", sizeof(double), NULL, 0, -1}, {"speed_z", sizeof(double), NULL, 0, -1},
+        {"mass", sizeof(double), NULL, 0, -1}, {"active", sizeof(bool), NULL, 0, -1}};
+    for (int c = 0; c < NUM_COLUMNS; c++)
+    {
+        if (!map_column(storage_dir, &columns[c], num_objects))
+        {
+            cerr << "No se puede crear la columna " << columns[c].name << " en " << storage_dir << "\n";
+            for (int k = 0; k < c; k++)
+            {
+                unmap_column(&columns[k]);
+            }
+            return -3;
+        }
+    }
+    object objects;
+    objects.pos_x = (double*)columns[POS_X].data;
+    objects.pos_y = (double*)columns[POS_Y].data;
+    objects.pos_z = (double*)columns[POS_Z].data;
+    objects.speed_x = (double*)columns[SPEED_X].data;
+    objects.speed_y = (double*)columns[SPEED_Y].data;
+    objects.speed_z = (double*)columns[SPEED_Z].data;
+    objects.mass = (double*)columns[MASS].data;
+    objects.active = (bool*)columns[ACTIVE].data;
+
+    /* Coordenadas y masas pseudoaleatorias */
+    mt19937_64 gen(random_seed);
+    uniform_real_distribution<double> position_dist(0.0, nextafter(size_enclosure, numeric_limits<double>::max()));
+    normal_distribution<double> mass_dist(M, SDM);
+
+    /* Fichero de configuracion inicial */
+    ofstream file_init;
+    file_init.open("init_config.txt");
+    file_init << fixed << setprecision(3) << size_enclosure << " " << time_step << " " << num_objects << endl;
+
+    /* Creación de objetos (las velocidades de un fichero nuevo ya son cero) */
+    for (int i = 0; i < num_objects; i++)
+    {
+        objects.pos_x[i] = position_dist(gen); // Posicion x, y, z
+        objects.pos_y[i] = position_dist(gen);
+        objects.pos_z[i] = position_dist(gen);
+        objects.mass[i] = mass_dist(gen); // Masa
+        objects.active[i] = true;
+
+        // Ponemos la precisión a 3 decimales. Imprimimos el objeto
+        file_init << fixed << setprecision(3) << objects.pos_x[i] << " " << objects.pos_y[i] << " " << objects.pos_z[i] << " " << objects.speed_x[i] << " " << objects.speed_y[i] << " " << objects.speed_z[i] << " " << objects.mass[i] << "\n";
+    }
+
+    file_init.close(); // Cerramos el fichero "init_config.txt"
+
+    /* Arena para los bloques residentes i y j y las fuerzas del bloque i (el único estado en memoria, O(tile)) */
+    arena scratch;
+    size_t resident_bytes = 4 * arena_round(sizeof(double) * tile_size) + arena_round(sizeof(bool) * tile_size);
+    if (!arena_init(&scratch, 2 * resident_bytes + arena_round(sizeof(vector_elem) * tile_size)))
+    {
+        cerr << "No se puede reservar la arena del bloque residente\n";
+        for (int c = 0; c < NUM_COLUMNS; c++)
+        {
+            unmap_column(&columns[c]);
+        }
+        return -3;
+    }
+    resident_tile tiles[2];
+    for (resident_tile &tile : tiles)
+    {
+        tile.pos_x = arena_array<double>(&scratch, tile_size);
+        tile.pos_y = arena_array<double>(&scratch, tile_size);
+        tile.pos_z = arena_array<double>(&scratch, tile_size);
+        tile.mass = arena_array<double>(&scratch, tile_size);
+        tile.active = arena_array<bool>(&scratch, tile_size);
+    }
+    vector_elem *forces = arena_array<vector_elem>(&scratch, tile_size);
+
+    /* Colisiones previas a las iteraciones */
+    collision_pass(num_objects, objects, columns, tile_size, &tiles[0], &tiles[1]);
+
+    /* Iteraciones: cada pasada recorre las columnas bloque a bloque */
+    io_counters io_start = read_io_counters();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t streamed = 0;
+    for (int iteration = 0; iteration < num_iterations; iteration++)
+    {
+        /* Fuerzas, aceleración y velocidad */
+        streamed += force_pass(num_objects, objects, columns, tile_size, &tiles[0], &tiles[1], forces, time_step);
+        /* Posiciones y bordes */
+        streamed += position_pass(num_objects, objects, columns, tile_size, time_step, size_enclosure);
+        /* Colisiones */
+        streamed += collision_pass(num_objects, objects, columns, tile_size, &tiles[0], &tiles[1]);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    io_counters io_end = read_io_counters();
+
+    /* Escribimos en el archivo "final_config.txt" los parámetros finales */
+    int alive = 0;
+    for (int i = 0; i < num_objects; i++)
+    {
+        alive += objects.active[i];
+    }
+    ofstream file_final;
+    file_final.open("final_config.txt");
+    file_final << fixed << setprecision(3) << size_enclosure << " " << time_step << " " << alive << endl;
+
+    for (int i = 0; i < num_objects; i++)
+    {
+        if(objects.active[i]==true){
+            file_final << fixed << setprecision(3) << objects.pos_x[i] << " " << objects.pos_y[i] << " " << objects.pos_z[i] << " " << objects.speed_x[i] << " " << objects.speed_y[i] << " " << objects.speed_z[i] << " " << objects.mass[i] << "\n";
+        }
+    }
+
+    file_final.close(); // Cerramos el fichero "final_config.txt"
+
+    /* Ancho de banda: bytes de columnas recorridos por los bloques y E/S real del dispositivo */
+    double mib = 1024.0 * 1024.0;
+    double column_bytes = 0;
+    for (int c = 0; c < NUM_COLUMNS; c++)
+    {
+        column_bytes += columns[c].bytes;
+    }
+    double device_bytes = (io_end.read_bytes - io_start.read_bytes) + (io_end.write_bytes - io_start.write_bytes);
+    cout << fixed << setprecision(2);
+    cout << "Storage: " << column_bytes / mib << " MiB of columns in " << storage_dir << ", tiles of " << tile_size << " objects\n";
+    cout << "Streamed: " << streamed / mib << " MiB of columns in " << seconds << " s (" << streamed / mib / seconds << " MiB/s)\n";
+    cout << "Device I/O: read " << (io_end.read_bytes - io_start.read_bytes) / mib << " MiB, written " << (io_end.write_bytes - io_start.write_bytes) / mib
+         << " MiB (" << device_bytes / mib / seconds << " MiB/s sustained)\n";
+    cout << "Peak memory: " << peak_rss_mib() << " MiB (scratch arena: " << scratch.peak / 1024.0 << " KiB)\n";
+    arena_free(&scratch);
+    for (int c = 0; c < NUM_COLUMNS; c++)
+    {
+        unmap_column(&columns[c]);
+    }
+}
+/* FUNCIONES */
+/* Crea el fichero de una columna en dir y lo proyecta en memoria compartida. El fichero se borra del
+   directorio en cuanto está proyectado: el espacio se libera al terminar aunque el programa falle */
+bool map_column(const string &dir, column_file *column, int num_objects)
+{
+    string path = dir + "/sim-soa-ooc." + to_string(getpid()) + "." + column->name;
+    column->bytes = column->element * (size_t)num_objects;
+    column->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (column->fd < 0)
+    {
+        return false;
+    }
+    unlink(path.c_str());
+    if (ftruncate(column->fd, column->bytes) != 0)
+    {
+        close(column->fd);
+        return false;
+    }
+    column->data = mmap(NULL, column->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, column->fd, 0);
+    if (column->data == MAP_FAILED)
+    {
+        column->data = NULL;
+        close(column->fd);
+        return false;
+    }
+    // Las pasadas recorren las columnas en orden: el kernel puede leer por delante y liberar lo ya recorrido
+    madvise(column->data, column->bytes, MADV_SEQUENTIAL);
+    return true;
+}
+
+/* Libera la proyección y el fichero de una columna */
+void unmap_column(column_file *column)
+{
+    munmap(column->data, column->bytes);
+    close(column->fd);
+}
+
+/* Pide al kernel que lea ya las páginas de los objetos [first, first + n) de las columnas which, para que el
+   siguiente bloque llegue del disco mientras se calcula el actual */
+void prefetch_tile(column_file *columns, const int *which, int count, long first, long n)
+{
+    static const long page = sysconf(_SC_PAGESIZE);
+    for (int c = 0; c < count; c++)
+    {
+        column_file *column = &columns[which[c]];
+        size_t start = first * column->element;
+        size_t end = min((first + n) * column->element, column->bytes);
+        start -= start % page;
+        if (end > start)
+        {
+            madvise((char*)column->data + start, end - start, MADV_WILLNEED);
+        }
+    }
+}
+
+/* Bytes de n objetos en las columnas which */
+size_t tile_bytes(column_file *columns, const int *which, int count, long n)
+{
+    size_t bytes = 0;
+    for (int c = 0; c < count; c++)
+    {
+        bytes += columns[which[c]].element * n;
+    }
+    return bytes;
+}
+
+/* Bytes leídos y escritos por el proceso en el dispositivo (ceros si /proc/self/io no está disponible) */
+io_counters read_io_counters()
+{
+    io_counters counters = {0, 0};
+    ifstream file("/proc/self/io");
+    string key;
+    long value;
+    while (file >> key >> value)
+    {
+        if (key == "read_bytes:")
+        {
+            counters.read_bytes = value;
+        }
+        else if (key == "write_bytes:")
+        {
+            counters.write_bytes = value;
+        }
+    }
+    return counters;
+}
+
+/* Copia las posiciones, masas y estado de los objetos [first, first + n) al bloque residente. Los hilos leen
+   partes distintas del bloque, así que los fallos de página de la proyección se reparten entre ellos */
+void load_tile(object objects, long first, long n, resident_tile *tile)
+{
+    #pragma omp parallel for
+    for (long k = 0; k < n; k++)
+    {
+        tile->pos_x[k] = objects.pos_x[first + k];
+        tile->pos_y[k] = objects.pos_y[first + k];
+        tile->pos_z[k] = objects.pos_z[first + k];
+        tile->mass[k] = objects.mass[first + k];
+        tile->active[k] = objects.active[first + k];
+    }
+}
+
+/* Distancia euclídea entre el objeto m del bloque j y el objeto k del bloque i */
+double euclidean_norm(resident_tile *source, long m, resident_tile *tile, long k)
+{
+    return std::sqrt((source->pos_x[m]- tile->pos_x[k]) * (source->pos_x[m]- tile->pos_x[k]) + (source->pos_y[m]- tile->pos_y[k]) * (source->pos_y[m]- tile->pos_y[k]) + (source->pos_z[m]- tile->pos_z[k]) * (source->pos_z[m]- tile->pos_z[k]));
+}
+
+/* Fuerza gravitatoria que ejerce el objeto m del bloque j sobre el objeto k del bloque i
+   (las mismas operaciones que vector_gravitational_force(objects, j, i) de sim-soa-opti.cpp) */
+void vector_gravitational_force(resident_tile *source, long m, resident_tile *tile, long k, vector_elem *forces)
+{
+    double dist = euclidean_norm(source, m, tile, k);
+    double Fg = GRAVITY_CONST * source->mass[m] * tile->mass[k]/ (dist*dist*dist);
+    forces->x += (Fg * (source->pos_x[m] - tile->pos_x[k]));
+    forces->y += (Fg * (source->pos_y[m] - tile->pos_y[k]));
+    forces->z += (Fg * (source->pos_z[m] - tile->pos_z[k]));
+}
+
+/* Vector aceleración */
+void vector_acceleration(resident_tile *tile, long k, vector_elem *forces, vector_elem *acceleration)
+{
+    /* Cálculo del vector aceleración */
+    acceleration->x = forces->x / tile->mass[k];
+    acceleration->y = forces->y / tile->mass[k];
+    acceleration->z = forces->z / tile->mass[k];
+}
+
+/* Vector velocidad */
+void vector_speed(object *objects, long i, vector_elem *acceleration, double time_step)
+{
+    /* Cálculo del vector velocidad */
+    objects->speed_x[i] += (acceleration->x * time_step);
+    objects->speed_z[i] += (acceleration->z * time_step);
+    objects->speed_y[i] += (acceleration->y * time_step);
+}
+
+/* Vector de posicion */
+void vector_position(object *objects, long i, double time_step)
+{
+    /* Cálculo del vector posición */
+    objects->pos_x[i] += (objects->speed_x[i] * time_step);
+    objects->pos_y[i] += (objects->speed_y[i] * time_step);
+    objects->pos_z[i] += (objects->speed_z[i] * time_step);
+}
+
+/* Función para recolocar al objeto si traspasa los límites */
+void check_border(object *objects, long i, double size_enclosure)
+{
+    // Checks posición x
+    if (objects->pos_x[i] <= 0)
+    {
+        objects->pos_x[i] = 0;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+    else if (objects->pos_x[i] >= size_enclosure)
+    {
+        objects->pos_x[i] = size_enclosure;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+
+    // Checks posición y
+    if (objects->pos_y[i] <= 0)
+    {
+        objects->pos_y[i] = 0;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+    else if (objects->pos_y[i] >= size_enclosure)
+    {
+        objects->pos_y[i] = size_enclosure;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+
+    // Checks posición z
+    if (objects->pos_z[i] <= 0)
+    {
+        objects->pos_z[i] = 0;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }
+    else if (objects->pos_z[i] >= size_enclosure)
+    {
+        objects->pos_z[i] = size_enclosure;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }
+}
+
+/* Comprobar colisión entre el objeto m del bloque j y el objeto k del bloque i (distancia euclídea menor que 1) */
+bool check_collision(resident_tile *source, long m, resident_tile *tile, long k)
+{
+    if (euclidean_norm(source, m, tile, k) < 1)
+    {
+        return true;
+    }
+    return false;
+}
+
+/* Fusionar el objeto j en el objeto i */
+void merge_objects(object objects, long i, long j)
+{
+    // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
+    objects.mass[i] += objects.mass[j];
+    objects.speed_x[i] += objects.speed_x[j];
+    objects.speed_y[i] += objects.speed_y[j];
+    objects.speed_z[i] += objects.speed_z[j];
+
+    // Se "elimina" el objeto
+    objects.active[j] = false;
+}
+
+/* Fuerzas, aceleración y velocidad: cada bloque i se copia a memoria y se recorren contra él todos los bloques
+   j, que también se copian de los ficheros, pidiendo el siguiente mientras se calcula el actual. Los objetos del
+   bloque i se reparten entre los hilos; cada uno suma sus pares en orden j creciente, como el bucle de
+   sim-soa-opti.cpp. Devuelve los bytes de columnas recorridos */
+size_t force_pass(int num_objects, object objects, column_file *columns, int tile_size, resident_tile *tile, resident_tile *source, vector_elem *forces, double time_step)
+{
+    size_t streamed = 0;
+    for (long i0 = 0; i0 < num_objects; i0 += tile_size)
+    {
+        long count = min((long)tile_size, num_objects - i0);
+        load_tile(objects, i0, count, tile);
+        for (long k = 0; k < count; k++)
+        {
+            forces[k] = {0.0, 0.0, 0.0};
+        }
+        for (long j0 = 0; j0 < num_objects; j0 += tile_size)
+        {
+            long j1 = min(j0 + tile_size, (long)num_objects);
+            load_tile(objects, j0, j1 - j0, source);
+            // Siguiente bloque j (o el primero, para el recorrido del siguiente bloque i)
+            prefetch_tile(columns, FORCE_COLUMNS, 5, j1 < num_objects ? j1 : 0, tile_size);
+            #pragma omp parallel for schedule(static)
+            for (long k = 0; k < count; k++)
+            {
+                long i = i0 + k;
+                if(tile->active[k]==true){
+                    for (long j = j0; j < j1; j++)
+                    {
+                        if (j != i && source->active[j - j0]==true){
+                            vector_gravitational_force(source, j - j0, tile, k, &forces[k]);
+                        }
+                    }
+                }
+            }
+            streamed += tile_bytes(columns, FORCE_COLUMNS, 5, j1 - j0);
+        }
+        #pragma omp parallel for
+        for (long k = 0; k < count; k++)
+        {
+            long i = i0 + k;
+            if(tile->active[k]==true){
+                // Cálculo del vector aceleración
+                vector_elem acceleration;
+                vector_acceleration(tile, k, &forces[k], &acceleration);
+                //  Cálculo del vector velocidad
+                vector_speed(&objects, i, &acceleration, time_step);
+            }
+        }
+        streamed += tile_bytes(columns, FORCE_COLUMNS, 5, count) + 3 * sizeof(double) * count;
+    }
+    return streamed;
+}
+
+/* Posiciones y bordes bloque a bloque, con los objetos de cada bloque repartidos entre los hilos.
+   Devuelve los bytes de columnas recorridos */
+size_t position_pass(int num_objects, object objects, column_file *columns, int tile_size, double time_step, double size_enclosure)
+{
+    size_t streamed = 0;
+    for (long i0 = 0; i0 < num_objects; i0 += tile_size)
+    {
+        long i1 = min(i0 + tile_size, (long)num_objects);
+        prefetch_tile(columns, POSITION_COLUMNS, 7, i1, tile_size);
+        #pragma omp parallel for
+        for (long i = i0; i < i1; i++)
+        {
+            if(objects.active[i]==true){
+                // Cálculo del vector posiciones
+                vector_position(&objects, i, time_step);
+                //  Comprobar bordes
+                check_border(&objects, i, size_enclosure);
+            }
+        }
+        streamed += tile_bytes(columns, POSITION_COLUMNS, 7, i1 - i0);
+    }
+    return streamed;
+}
+
+/* Colisiones bloque a bloque: el bloque i en memoria contra las copias de los bloques j >= i. Las fusiones no
+   mueven los objetos, así que los pares en contacto se buscan en paralelo con el estado del principio de la
+   pasada y después se fusionan en orden (i, j) saltando los que ya se han eliminado: el mismo resultado que el
+   bucle (i, j) de sim-soa-opti.cpp. Devuelve los bytes de columnas recorridos */
+size_t collision_pass(int num_objects, object objects, column_file *columns, int tile_size, resident_tile *tile, resident_tile *source)
+{
+    size_t streamed = 0;
+    vector<pair<long, long>> contacts;
+    for (long i0 = 0; i0 < num_objects; i0 += tile_size)
+    {
+        long count = min((long)tile_size, num_objects - i0);
+        load_tile(objects, i0, count, tile);
+        for (long j0 = i0; j0 < num_objects; j0 += tile_size)
+        {
+            long j1 = min(j0 + tile_size, (long)num_objects);
+            load_tile(objects, j0, j1 - j0, source);
+            prefetch_tile(columns, COLLISION_COLUMNS, 4, j1 < num_objects ? j1 : i0 + tile_size, tile_size);
+            #pragma omp parallel
+            {
+                vector<pair<long, long>> found;
+                #pragma omp for schedule(dynamic, 64) nowait
+                for (long k = 0; k < count; k++)
+                {
+                    long i = i0 + k;
+                    if (tile->active[k]==true){
+                        for (long j = max(j0, i + 1); j < j1; j++)
+                        {
+                            if (source->active[j - j0]==true && check_collision(source, j - j0, tile, k))
+                            {
+                                found.push_back({i, j});
+                            }
+                        }
+                    }
+                }
+                #pragma omp critical
+                contacts.insert(contacts.end(), found.begin(), found.end());
+            }
+            streamed += tile_bytes(columns, COLLISION_COLUMNS, 4, j1 - j0);
+        }
+    }
+    sort(contacts.begin(), contacts.end());
+    for (const pair<long, long> &contact : contacts)
+    {
+        // Colision entre objetos diferentes que no hayan sido eliminados con anterioridad
+        if (objects.active[contact.first]==true && objects.active[contact.second]==true)
+        {
+            merge_objects(objects, contact.first, contact.second);
+        }
+    }
+    return streamed;
+}
@@ -5,6 +5,7 @@
 #include <random>
 #include <vector>
 #include <iomanip>
+#include "arena.hpp"
 
 using namespace std;
 
@@ -135,9 +136,19 @@ int main(int argc, char const *argv[])
     // Actualizamos el número de objetos en el vector
     num_objects = objects.mass.size();
 
+    /* Arena para los buffers temporales de cada iteración (se reserva una vez y se reinicia en cada iteración) */
+    arena scratch;
+    if (!arena_init(&scratch, arena_round(sizeof(vector_elem)*num_objects)))
+    {
+        cerr << "No se puede reservar la arena de los buffers temporales\n";
+        return -3;
+    }
+
     /* Iteraciones */
     for (int iteration = 0; iteration < num_iterations; iteration++)
     {
+        arena_reset(&scratch);
+        vector_elem *acceleration = arena_array<vector_elem>(&scratch, num_objects);
         /* Bucle para obtener nuevas propiedades de los objetos en la iteración (fuerzas, aceleración y velocidad) */
         for (int i = 0; i < num_objects; i++)
         {
@@ -146,10 +157,9 @@ int main(int argc, char const *argv[])
             double forces[3] = {0.0, 0.0, 0.0};
             calc_gravitational(num_objects, i, objects, forces);
             // Cálculo del vector aceleración
-            vector_elem *acceleration = (vector_elem *)malloc(sizeof(vector_elem));
-            vector_acceleration(objects, i, forces, acceleration);
+            vector_acceleration(objects, i, forces, &acceleration[i]);
             //  Cálculo del vector velocidad
-            vector_speed(&objects, i, acceleration, time_step);
+            vector_speed(&objects, i, &acceleration[i], time_step);
         }
 
 
@@ -205,6 +215,8 @@ int main(int argc, char const *argv[])
     }
 
     file_init.close(); // Cerramos el fichero "final_config.txt"
+    cout<<"Peak memory: "<<peak_rss_mib()<<" MiB (scratch arena: "<<scratch.peak/1024.0<<" KiB)\n";
+    arena_free(&scratch);
 }
 /* FUNCIONES */
 /* Distancia euclídea entre dos objetos */
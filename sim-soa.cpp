@@ -6,6 +6,7 @@
 #include <vector>
 #include <iomanip>
 #include <omp.h>
+#include "arena.hpp"
 
 using namespace std;
 
@@ -135,17 +136,29 @@ int main(int argc, char const *argv[])
         }
     }
 
+    /* Arena para los buffers temporales de cada iteración (se reserva una vez y se reinicia en cada iteración) */
+    arena scratch;
+    if (!arena_init(&scratch, arena_round(sizeof(vector_elem)*num_objects) * 2))
+    {
+        cerr << "No se puede reservar la arena de los buffers temporales\n";
+        return -3;
+    }
+
     /* Iteraciones */
     for (int iteration = 0; iteration < num_iterations; iteration++)
     {
-        struct vector_elem *acceleration = (vector_elem*)malloc(sizeof(vector_elem)*num_objects);
-        struct vector_elem *forces = (vector_elem*)malloc(sizeof(vector_elem)*num_objects);
+        arena_reset(&scratch);
+        struct vector_elem *acceleration = arena_array<vector_elem>(&scratch, num_objects);
+        struct vector_elem *forces = arena_array<vector_elem>(&scratch, num_objects);
         /* Bucle para obtener nuevas propiedades de los objetos en la iteración (fuerzas)*/
         for (int i = 0; i < num_objects; i++)
         {
             if(objects.active[i]==true){
                 // Solo entrarán en el condicional objetos que no se han eliminado
                 // Cálculo de la fuerza gravitatoria
+                forces[i].x = 0;
+                forces[i].y = 0;
+                forces[i].z = 0;
                 calc_gravitational(num_objects, i, objects, &forces[i]);
             }
         }
@@ -228,6 +241,8 @@ int main(int argc, char const *argv[])
     file_init.close(); // Cerramos el fichero "final_config.txt"
     end = omp_get_wtime();
     cout<<"Time: "<<end-start<<"\n";
+    cout<<"Peak memory: "<<peak_rss_mib()<<" MiB (scratch arena: "<<scratch.peak/1024.0<<" KiB)\n";
+    arena_free(&scratch);
 }
 /* FUNCIONES */
 /* Distancia euclídea entre dos objetos */
@@ -0,0 +1,2419 @@
+/* Simulación de objetos con gravedad (SoA paralelo) como biblioteca header-only.
+   Uso: Simulation sim(num_objects, random_seed, size_enclosure, time_step, options); sim.step(n);
+   y lectura del estado sin copias con sim.pos_x(), sim.speed_x(), sim.masses(), sim.ids()... */
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+/* Librerias */
+#include <math.h>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <span>
+#include <complex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "arena.hpp"
+#include "backend.hpp"
+
+/* CONSTANTES */
+const double GRAVITY_CONST = 6.674 * 1E-11; // Constante gravedad universal
+const double M = 1E21;                      // Media (distribución normal)
+const double SDM = 1E15;                    // Desviación (distribución normal)
+const char AUTOTUNE_FILE[] = "autotune.txt"; // Decisiones de autotune por máquina y rango de num_objects
+const int REPRO_LANES = 8;                  // Acumuladores intercalados por bloque con --reproducible (j % 8)
+const int REPRO_BLOCK = 256;                // Objetos j por bloque del árbol de reducción con --reproducible
+const double COLLISION_TOLERANCE = 1E-9;    // Tolerancia relativa de la planificación de colisiones (redondeo)
+
+/* ESTRUCTURAS */
+/* Estructura objeto */
+struct object {
+    double *pos_x;
+    double *pos_y;
+    double *pos_z;
+    double *speed_x;
+    double *speed_y;
+    double *speed_z;
+    double *mass;
+    bool *active;
+    int *id;        // Orden de creación (se mantiene al reordenar)
+};
+
+/* Estructura vector_elem */
+struct vector_elem{
+    double x;
+    double y;
+    double z;
+};
+
+/* Integradores disponibles */
+enum integrator_type {
+    EULER,    // Euler: velocidad y posición con la aceleración del paso actual
+    LEAPFROG, // Leapfrog kick-drift-kick (velocity Verlet), reutiliza la aceleración del paso anterior
+    BLOCK     // Leapfrog con pasos individuales por bloques (time_step / 2^nivel de cada objeto)
+};
+
+/* Comprobación de colisiones disponible */
+enum collision_type {
+    ALL_PAIRS, // Todos los pares de objetos en cada iteración
+    VERLET     // Solo los pares de las listas de vecinos (radio 1 + skin)
+};
+
+/* Cálculo de fuerzas disponible */
+enum force_type {
+    DIRECT, // Suma directa sobre todos los pares (calc_gravitational)
+    CUTOFF, // Solo pares a menos de cutoff, con suavizado de Plummer, usando listas de celdas
+    PM      // Particle-Mesh: masa en una malla (CIC), potencial con FFT y fuerzas interpoladas de la malla
+};
+
+/* Estructura opciones: argumentos opcionales --nombre=valor tras los obligatorios */
+struct sim_options {
+    integrator_type integrator;
+    collision_type collision;
+    force_type force;
+    double cutoff;    // Radio de corte de las fuerzas con CUTOFF
+    double softening; // Longitud de suavizado de Plummer con CUTOFF: F = G m1 m2 r / (r^2 + softening^2)^(3/2)
+    int pm_grid;      // Puntos por dimensión de la malla de PM (potencia de dos)
+    double skin;      // Margen de las listas de vecinos sobre la distancia de colisión
+    int morton;       // Reordenar los objetos por código Morton cada morton iteraciones (0: nunca)
+    bool energy;      // Informar de la deriva de la energía total
+    int monitor;      // Monitor de cantidades conservadas: potencial cada monitor iteraciones (0: desactivado)
+    int threads;      // Hilos de OpenMP en step() (0: los del programa)
+    int tile;         // Bloques de tile x tile pares en la suma directa, en paralelo (0: bucle por objeto en serie)
+    bool autotune;    // Elegir threads, tile y collision midiendo los núcleos al empezar (ver autotune)
+    bool replan;      // Volver a elegir el plan cada vez que los objetos activos bajan de una potencia de dos
+    int output_every; // Guardar una instantánea cada output_every iteraciones (0: solo configuración inicial y final)
+    int output_queue; // Instantáneas máximas pendientes de escribir antes de que la simulación espere
+    double compress;  // Cota de error relativa de las instantáneas de output_every comprimidas con codec.hpp (0: texto)
+    backend_type backend; // Backend de los bucles por objeto (fuerzas, integración, bordes) y de colisiones
+    task_pool *pool;      // Pool de tareas con TASK_POOL (NULL: Simulation crea un thread_pool propio)
+    bool reproducible;    // Reducciones con orden fijo: resultados idénticos con cualquier número de hilos y backend
+    int rsqrt;            // Suma directa con 1/r^3 a partir de rsqrt y rsqrt pasos de Newton-Raphson (0: sqrt y división)
+    int block_levels; // Niveles de subdivisión del paso con BLOCK (paso mínimo time_step / 2^block_levels)
+    double block_eta; // Desplazamiento máximo debido a la aceleración en un paso individual con BLOCK
+};
+
+/* Estructura lista de vecinos (Verlet) para las colisiones, en formato CSR */
+struct neighbour_list {
+    int *start;         // Inicio de los vecinos de cada objeto en neighbours (num_objects + 1)
+    int *neighbours;    // Vecinos j > i a menos de 1 + skin al construir la lista, en orden creciente
+    long capacity;      // Tamaño reservado de neighbours
+    double *ref_x;      // Posiciones al construir la lista
+    double *ref_y;
+    double *ref_z;
+    bool built;
+    bool valid;         // false si los objetos se han reordenado desde la construcción
+    int rebuilds;       // Estadísticas: reconstrucciones, pasadas de colisión y longitud de las listas
+    int passes;
+    long total_length;
+    long total_objects;
+};
+
+/* Estructura de la planificación de colisiones con ALL_PAIRS: tras cada pasada completa se guardan las posiciones
+   y la menor distancia entre pares activos. Dos objetos se acercan como mucho la suma de sus desplazamientos, así
+   que mientras el doble del mayor desplazamiento no llegue a margin ningún par puede estar a menos de 1 */
+struct collision_schedule {
+    double *ref_x;      // Posiciones en la última pasada completa
+    double *ref_y;
+    double *ref_z;
+    double margin;      // Menor distancia entre pares activos en esa pasada, menos 1 y la tolerancia de redondeo
+    bool built;
+    bool valid;         // false si los objetos se han reordenado desde la última pasada completa
+    int skipped;        // Estadísticas: pasadas saltadas y pasadas totales
+    int passes;
+};
+
+/* Estructura lista de celdas: el recinto dividido en per_dim^3 celdas de lado >= cutoff, con los objetos
+   activos de cada celda contiguos (formato CSR). Los pares a menos de cutoff están en celdas vecinas */
+struct cell_list {
+    int per_dim;        // Celdas por dimensión
+    double cell_size;
+    int *cell_start;    // Inicio de cada celda en cell_objects (per_dim^3 + 1)
+    int *cell_objects;  // Índices de los objetos ordenados por celda (en orden creciente dentro de cada celda)
+    int *object_cell;   // Celda de cada objeto (-1 si no está activo)
+    int *histogram;     // Recuento por celda de cada hilo al construir (celdas x hilos)
+    long cell_capacity; // Tamaños reservados
+    long object_capacity;
+    long histogram_capacity;
+};
+
+/* Estructura malla de PM: G^3 celdas de lado spacing sobre el recinto. El potencial se calcula con una malla
+   de (2G)^3 con ceros fuera del recinto, así la convolución circular de la FFT equivale a condiciones aisladas */
+struct pm_grid {
+    int size;                       // G: puntos por dimensión del recinto
+    double spacing;                 // Lado de una celda (size_enclosure / G)
+    std::complex<double> *density;  // Masa por celda y después potencial, (2G)^3
+    double *green;                  // Transformada de la función de Green -G/r en la malla (2G)^3 (real por simetría)
+    double *accel_x;                // Aceleración en cada celda del recinto, G^3
+    double *accel_y;
+    double *accel_z;
+    bool built;
+};
+
+/* Estructura muestra del monitor: cantidades conservadas del estado tras iteration iteraciones */
+struct monitor_sample {
+    int iteration;
+    double kinetic;         // Energía cinética
+    double potential;       // Energía potencial (NAN si no toca calcularla en esta muestra)
+    vector_elem momentum;   // Momento lineal total
+    vector_elem angular;    // Momento angular total respecto al origen
+};
+
+/* Estructura plan de ejecución: configuración de los núcleos que no cambia los resultados */
+struct execution_plan {
+    int threads;
+    int tile;
+    collision_type collision;
+};
+
+/* Estructura cambio de plan: registro de cada cambio del plan de ejecución durante la simulación */
+struct plan_change {
+    int iteration;          // Iteración antes de la que se aplica
+    int objects;            // Objetos activos al elegirlo
+    execution_plan plan;
+    bool cached;            // Tomado del fichero de decisiones (sin medir)
+    double seconds;         // Tiempo de la elección
+};
+
+/* Estructura force_field: estructuras auxiliares del cálculo de fuerzas elegido */
+struct force_field {
+    cell_list cells;
+    pm_grid pm;
+};
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+inline double euclidean_norm(object objects, int index_1, int index_2);
+inline double vector_gravitational_force(object objects, int index_1, int index_2, vector_elem* forces);
+inline void calc_gravitational(int num_objects, int k, object objects, vector_elem* forces, double *potential = NULL);
+inline void calc_gravitational_reproducible(int num_objects, int i, object objects, vector_elem *forces, double *potential = NULL);
+inline double rsqrt_estimate(double r2, int refinements);
+inline double vector_gravitational_force_rsqrt(object objects, int i, int j, vector_elem *forces, int refinements);
+inline void calc_gravitational_rsqrt(int j0, int j1, int i, object objects, int refinements, vector_elem *forces, double *potential = NULL);
+inline void vector_acceleration(object objects, int i, vector_elem* forces, vector_elem* acceleration);
+inline void vector_speed(object *objects, int i, vector_elem *acceleration, double time_step);
+inline void vector_position(object *objects, int i, double time_step);
+inline void check_border(object *objects, int i, double size_enclosure);
+inline void kick_drift(double *position, double *speed, double acceleration, double kick, double drift, double size_enclosure);
+inline void integrate_body(object objects, int i, const vector_elem *acceleration, double kick, double drift, double size_enclosure);
+inline bool check_collision(object objects, int i, int j);
+inline void merge_objects(object objects, int i, int j);
+inline double check_collisions(int num_objects, object objects, sim_options *options);
+inline void collision_pass(int num_objects, object objects, neighbour_list *list, collision_schedule *schedule, sim_options *options);
+inline void build_neighbour_list(int num_objects, object objects, neighbour_list *list, double skin);
+inline void check_collisions_verlet(int num_objects, object objects, neighbour_list *list, double skin);
+inline int cell_of(object objects, int i, cell_list *cells);
+inline void build_cell_list(int num_objects, object objects, cell_list *cells, double size_enclosure, double cutoff);
+inline void calc_gravitational_cutoff(int i, object objects, cell_list *cells, sim_options *options, vector_elem *forces, double *potential = NULL);
+inline void fft_1d(std::complex<double> *line, int n, bool inverse);
+inline void fft_3d(std::complex<double> *data, int n, bool inverse);
+inline void cic_weights(double position, double spacing, int size, int *index, double *weight);
+inline void pm_init(pm_grid *pm, double size_enclosure, int size);
+inline void pm_solve(int num_objects, object objects, pm_grid *pm, bool reproducible);
+inline void pm_force(int i, object objects, pm_grid *pm, vector_elem *forces, double *potential = NULL);
+inline void prepare_forces(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options);
+inline void calc_force(int num_objects, int i, object objects, force_field *field, sim_options *options, vector_elem *forces, double *potential = NULL);
+inline void calc_gravitational_tiled(int num_objects, object objects, sim_options *options, vector_elem *forces, double *potential);
+inline bool parallel_forces(const sim_options *options);
+inline void calc_forces(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options, vector_elem *forces, double *potential = NULL);
+inline void calc_accelerations(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options, vector_elem *forces, vector_elem *acceleration, double *potential = NULL);
+inline double total_energy(int num_objects, object objects, const sim_options *options);
+inline void conserved_quantities(int num_objects, object objects, monitor_sample *sample, bool reproducible);
+inline int block_level(vector_elem *acceleration, double time_step, sim_options *options);
+inline long block_step(int num_objects, object objects, int *level, vector_elem *forces, vector_elem *acceleration, neighbour_list *list, collision_schedule *schedule, force_field *field, double time_step, double size_enclosure, sim_options *options, long *global_evaluations);
+inline uint64_t spread_bits(uint64_t value);
+inline uint64_t morton_code(object objects, int i, double size_enclosure);
+inline void radix_sort(uint64_t *keys, int *index, int n, uint64_t *keys_tmp, int *index_tmp, std::vector<int> *counts);
+template <class T> void permute(T *column, int *index, int n, void *scratch);
+inline int morton_reorder(int num_objects, object objects, vector_elem *acceleration, int *level, double size_enclosure, arena *scratch, std::vector<int> *histogram);
+
+/* Opciones por defecto: Euler, colisiones entre todos los pares y sin reordenación */
+inline sim_options default_options();
+inline bool parse_options(int argc, char const *argv[], int first, sim_options *options);
+class Simulation;
+inline execution_plan autotune(Simulation *simulation, const char *cache_path, bool *cached, double *seconds);
+
+/* CLASE SIMULATION */
+/* Estado completo de una simulación. Los objetos se generan en el constructor con la semilla (igual que los
+   binarios); las colisiones iniciales se comprueban en la primera llamada a step(), así el estado generado se
+   puede leer antes. Tras cada step() los objetos eliminados se descartan y las vistas solo contienen objetos
+   activos, en orden de creación salvo con options.morton */
+class Simulation {
+public:
+    Simulation(int num_objects, int random_seed, double size_enclosure, double time_step, sim_options options = default_options());
+    ~Simulation();
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    /* Avanza iterations iteraciones */
+    void step(int iterations = 1);
+
+    /* Vistas de solo lectura sobre las columnas (válidas hasta la siguiente llamada a step()) */
+    int count() const { return num_objects; }
+    int created() const { return total_objects; }
+    std::span<const double> pos_x() const { return {objects.pos_x, (size_t)num_objects}; }
+    std::span<const double> pos_y() const { return {objects.pos_y, (size_t)num_objects}; }
+    std::span<const double> pos_z() const { return {objects.pos_z, (size_t)num_objects}; }
+    std::span<const double> speed_x() const { return {objects.speed_x, (size_t)num_objects}; }
+    std::span<const double> speed_y() const { return {objects.speed_y, (size_t)num_objects}; }
+    std::span<const double> speed_z() const { return {objects.speed_z, (size_t)num_objects}; }
+    std::span<const double> masses() const { return {objects.mass, (size_t)num_objects}; }
+    std::span<const int> ids() const { return {objects.id, (size_t)num_objects}; }
+
+    /* Parámetros y estadísticas */
+    double enclosure() const { return size_enclosure; }
+    double step_size() const { return time_step; }
+    const sim_options &get_options() const { return options; }
+    int iteration() const { return iterations_done; }
+    double energy() const { return total_energy(num_objects, objects, &options); }
+    double energy_drift() const { return (energy() - initial_energy) / fabs(initial_energy); }
+    const neighbour_list &neighbours() const { return list; }
+    const collision_schedule &collisions() const { return schedule; }
+    long force_evaluations() const { return block_evaluations; }
+    size_t arena_peak() const { return bodies.peak + scratch.peak; }
+    long global_force_evaluations() const { return global_evaluations; }
+    const std::vector<monitor_sample> &monitor() const { return samples; }
+    double monitor_overhead() const;
+
+    /* Plan de ejecución: hilos, bloques de la suma directa y comprobación de colisiones (mismos resultados) */
+    execution_plan plan() const { return {options.threads, options.tile, options.collision}; }
+    void set_plan(const execution_plan &plan);
+    double benchmark_forces(const execution_plan &plan, int repetitions);
+    double benchmark_collisions(const execution_plan &plan, int repetitions);
+    const std::vector<plan_change> &plan_changes() const { return plan_log; }
+
+    /* Ejecuta los bucles paralelos en el pool de tareas de la aplicación (antes del primer step()) */
+    void set_task_pool(task_pool *pool) { options.backend = TASK_POOL; options.pool = pool; }
+
+private:
+    void start();
+    void compact();
+    bool potential_due(int iteration) const { return options.monitor > 0 && iteration % options.monitor == 0; }
+    void record(int iteration, double potential);
+    void replan(int iteration);
+
+    object objects;
+    arena bodies;                          // Columnas de los objetos y buffers persistentes (alineados a 64 bytes)
+    arena scratch;                         // Buffers temporales de cada iteración (se reinicia al empezarla)
+    int num_objects;
+    int total_objects;                     // Objetos creados (num_objects se reduce al compactar)
+    double size_enclosure;
+    double time_step;
+    sim_options options;
+    neighbour_list list = {};              // Listas de vecinos para las colisiones (se construyen en la primera pasada)
+    collision_schedule schedule = {};      // Pasadas de colisiones que se pueden saltar con ALL_PAIRS
+    force_field field = {};                // Listas de celdas de CUTOFF (se construyen antes de cada evaluación)
+    vector_elem *lf_forces = NULL;         // Fuerzas y aceleraciones persistentes de leapfrog y pasos por bloques
+    vector_elem *lf_acceleration = NULL;
+    int *level = NULL;                     // Nivel del paso individual de cada objeto (BLOCK)
+    std::vector<int> radix_histogram;      // Recuento por dígito y por hilo de la ordenación Morton
+    long block_evaluations = 0;            // Interacciones calculadas con pasos por bloques
+    long global_evaluations = 0;           // Interacciones que necesitaría leapfrog con un paso global de time_step
+    double initial_energy = 0;
+    std::vector<monitor_sample> samples;   // Muestras del monitor de cantidades conservadas
+    double monitor_time = 0;               // Tiempo de las reducciones del monitor (y de las pasadas de potencial aparte)
+    double force_time[2] = {0, 0};         // Tiempo y número de evaluaciones de fuerzas sin y con potencial
+    int force_passes[2] = {0, 0};
+    double step_time = 0;                  // Tiempo total dentro de step()
+    int plan_range = 0;                    // Potencia de dos <= objetos activos al fijar el plan (0: sin plan)
+    std::vector<plan_change> plan_log;     // Cambios de plan con options.replan
+    thread_pool *own_pool = NULL;          // Pool propio con TASK_POOL si la aplicación no da uno
+    task_pool own_task_pool = {};
+    bool started = false;
+    int iterations_done = 0;
+};
+
+/* FUNCIONES */
+/* Distancia euclídea entre dos objetos */
+inline double euclidean_norm(object objects, int i, int j)
+{
+    return std::sqrt((objects.pos_x[i]- objects.pos_x[j]) * (objects.pos_x[i]- objects.pos_x[j]) + (objects.pos_y[i]- objects.pos_y[j]) * (objects.pos_y[i]- objects.pos_y[j]) + (objects.pos_z[i]- objects.pos_z[j]) * (objects.pos_z[i]- objects.pos_z[j]));
+}
+
+/* Fuerza gravitatoria entre dos objetos (devuelve su distancia) */
+inline double vector_gravitational_force(object objects, int i, int j, vector_elem *forces)
+{
+    double dist = euclidean_norm(objects, i, j);
+    double Fg = GRAVITY_CONST * objects.mass[i] * objects.mass[j]/ (dist*dist*dist);
+    forces->x += (Fg * (objects.pos_x[i] - objects.pos_x[j]));
+    forces->y += (Fg * (objects.pos_y[i] - objects.pos_y[j]));
+    forces->z += (Fg * (objects.pos_z[i] - objects.pos_z[j]));
+    return dist;
+}
+
+/* Fuerza gravitatoria que ejerce un objeto. Si potential no es NULL se le suma la mitad de la energía potencial
+   de los pares del objeto, con la misma distancia que la fuerza (cada par se visita desde sus dos objetos) */
+inline void calc_gravitational(int num_objects, int i, object objects, vector_elem *forces, double *potential){
+    if (potential == NULL){
+        for (int j = 0; j < num_objects; j++){
+            if (j != i && objects.active[j]==true){
+                vector_gravitational_force(objects, j, i, forces);
+            }
+        }
+        return;
+    }
+    for (int j = 0; j < num_objects; j++){
+        if (j != i && objects.active[j]==true){
+            double dist = vector_gravitational_force(objects, j, i, forces);
+            *potential -= 0.5 * GRAVITY_CONST * objects.mass[i] * objects.mass[j] / dist;
+        }
+    }
+}
+
+/* 1/sqrt(r2) con la estimación rsqrt de SSE (12 bits, en float) y refinements pasos de Newton-Raphson en
+   double, y = y * (1.5 - 0.5 * r2 * y * y). Cada paso duplica los bits correctos: el error relativo queda en
+   torno a 1e-7 con un paso y a 1e-13 con dos. Sin SSE la estimación es 1/sqrt en float */
+inline double rsqrt_estimate(double r2, int refinements)
+{
+#if defined(__SSE2__)
+    double y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss((float)r2)));
+#else
+    double y = 1.0f / std::sqrt((float)r2);
+#endif
+    y = y * (1.5 - 0.5 * r2 * y * y);
+    if (refinements > 1)
+    {
+        y = y * (1.5 - 0.5 * r2 * y * y);
+    }
+    return y;
+}
+
+/* Fuerza gravitatoria entre dos objetos con 1/r^3 = rsqrt(r^2)^3, sin sqrt ni división (devuelve su distancia) */
+inline double vector_gravitational_force_rsqrt(object objects, int i, int j, vector_elem *forces, int refinements)
+{
+    double dx = objects.pos_x[i] - objects.pos_x[j];
+    double dy = objects.pos_y[i] - objects.pos_y[j];
+    double dz = objects.pos_z[i] - objects.pos_z[j];
+    double r2 = dx * dx + dy * dy + dz * dz;
+    double inv_dist = rsqrt_estimate(r2, refinements);
+    double Fg = GRAVITY_CONST * objects.mass[i] * objects.mass[j] * (inv_dist * inv_dist * inv_dist);
+    forces->x += (Fg * dx);
+    forces->y += (Fg * dy);
+    forces->z += (Fg * dz);
+    return r2 * inv_dist;
+}
+
+/* Fuerza gravitatoria sobre el objeto i de los objetos j0..j1-1 con --rsqrt. Con SSE2 se calculan dos pares a
+   la vez: una sola instrucción rsqrt estima 1/r de los dos, se refina en double y 1/r^3 = y^3, sin sqrt ni
+   división. Los pares con j == i o con j inactivo se anulan con una máscara. Los dos carriles se suman al final,
+   así que el orden de suma (y el redondeo) no es el de calc_gravitational. Si potential no es NULL se le suma la
+   mitad de la energía potencial de los pares, -G m_i m_j / r con la misma estimación de 1/r */
+inline void calc_gravitational_rsqrt(int j0, int j1, int i, object objects, int refinements, vector_elem *forces, double *potential)
+{
+    int j = j0;
+    double energy = 0;
+#if defined(__SSE2__)
+    __m128d xi = _mm_set1_pd(objects.pos_x[i]);
+    __m128d yi = _mm_set1_pd(objects.pos_y[i]);
+    __m128d zi = _mm_set1_pd(objects.pos_z[i]);
+    __m128d gm = _mm_set1_pd(GRAVITY_CONST * objects.mass[i]);
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d three_halves = _mm_set1_pd(1.5);
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d fx = _mm_setzero_pd();
+    __m128d fy = _mm_setzero_pd();
+    __m128d fz = _mm_setzero_pd();
+    __m128d pe = _mm_setzero_pd();
+    for (; j + 1 < j1; j += 2)
+    {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(&objects.pos_x[j]), xi);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(&objects.pos_y[j]), yi);
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(&objects.pos_z[j]), zi);
+        __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+        // Máscara de pares válidos; los demás toman r^2 = 1 para no generar inf ni NaN
+        __m128d valid = _mm_castsi128_pd(_mm_set_epi64x(-(long long)(j + 1 != i && objects.active[j + 1]), -(long long)(j != i && objects.active[j])));
+        r2 = _mm_or_pd(_mm_and_pd(valid, r2), _mm_andnot_pd(valid, one));
+        __m128d y = _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(r2)));
+        y = _mm_mul_pd(y, _mm_sub_pd(three_halves, _mm_mul_pd(_mm_mul_pd(half, r2), _mm_mul_pd(y, y))));
+        if (refinements > 1)
+        {
+            y = _mm_mul_pd(y, _mm_sub_pd(three_halves, _mm_mul_pd(_mm_mul_pd(half, r2), _mm_mul_pd(y, y))));
+        }
+        __m128d gmm = _mm_and_pd(valid, _mm_mul_pd(gm, _mm_loadu_pd(&objects.mass[j])));
+        __m128d Fg = _mm_mul_pd(gmm, _mm_mul_pd(y, _mm_mul_pd(y, y)));
+        fx = _mm_add_pd(fx, _mm_mul_pd(Fg, dx));
+        fy = _mm_add_pd(fy, _mm_mul_pd(Fg, dy));
+        fz = _mm_add_pd(fz, _mm_mul_pd(Fg, dz));
+        pe = _mm_add_pd(pe, _mm_mul_pd(gmm, y));
+    }
+    double lane[2];
+    _mm_storeu_pd(lane, fx);
+    forces->x += lane[0] + lane[1];
+    _mm_storeu_pd(lane, fy);
+    forces->y += lane[0] + lane[1];
+    _mm_storeu_pd(lane, fz);
+    forces->z += lane[0] + lane[1];
+    _mm_storeu_pd(lane, pe);
+    energy -= 0.5 * (lane[0] + lane[1]);
+#endif
+    for (; j < j1; j++)
+    {
+        if (j != i && objects.active[j]==true){
+            double dist = vector_gravitational_force_rsqrt(objects, j, i, forces, refinements);
+            energy -= 0.5 * GRAVITY_CONST * objects.mass[i] * objects.mass[j] / dist;
+        }
+    }
+    if (potential != NULL)
+    {
+        *potential += energy;
+    }
+}
+
+/* Fuerza gravitatoria con un orden de suma fijo, independiente de hilos y ancho SIMD: los objetos j se suman
+   en bloques de REPRO_BLOCK con REPRO_LANES acumuladores intercalados (j % REPRO_LANES) que se combinan por
+   parejas, y los bloques se combinan con un árbol binario que solo depende de num_objects. Cualquier reparto
+   en paralelo o vectorizado que respete ese árbol da las mismas fuerzas bit a bit */
+inline void calc_gravitational_reproducible(int num_objects, int i, object objects, vector_elem *forces, double *potential)
+{
+    vector_elem stack[64];      // Sumas de bloques pendientes (subárboles de 2^k bloques)
+    long stack_size[64];
+    double stack_energy[64];
+    int top = 0;
+    for (int j0 = 0; j0 < num_objects; j0 += REPRO_BLOCK)
+    {
+        vector_elem lane[REPRO_LANES] = {};
+        double lane_energy[REPRO_LANES] = {};
+        int j1 = std::min(j0 + REPRO_BLOCK, num_objects);
+        for (int j = j0; j < j1; j++)
+        {
+            if (j != i && objects.active[j]==true){
+                double dist = vector_gravitational_force(objects, j, i, &lane[j % REPRO_LANES]);
+                if (potential != NULL)
+                {
+                    lane_energy[j % REPRO_LANES] -= 0.5 * GRAVITY_CONST * objects.mass[i] * objects.mass[j] / dist;
+                }
+            }
+        }
+        for (int width = 1; width < REPRO_LANES; width *= 2)
+        {
+            for (int k = 0; k + width < REPRO_LANES; k += 2 * width)
+            {
+                lane[k].x += lane[k + width].x;
+                lane[k].y += lane[k + width].y;
+                lane[k].z += lane[k + width].z;
+                lane_energy[k] += lane_energy[k + width];
+            }
+        }
+
+        // Árbol de bloques: se combinan los dos últimos subárboles mientras tengan el mismo tamaño
+        stack[top] = lane[0];
+        stack_energy[top] = lane_energy[0];
+        stack_size[top] = 1;
+        top++;
+        while (top > 1 && stack_size[top - 1] == stack_size[top - 2])
+        {
+            top--;
+            stack[top - 1].x += stack[top].x;
+            stack[top - 1].y += stack[top].y;
+            stack[top - 1].z += stack[top].z;
+            stack_energy[top - 1] += stack_energy[top];
+            stack_size[top - 1] *= 2;
+        }
+    }
+    for (top--; top > 0; top--)
+    {
+        stack[top - 1].x += stack[top].x;
+        stack[top - 1].y += stack[top].y;
+        stack[top - 1].z += stack[top].z;
+        stack_energy[top - 1] += stack_energy[top];
+    }
+    if (num_objects > 0)
+    {
+        forces->x += stack[0].x;
+        forces->y += stack[0].y;
+        forces->z += stack[0].z;
+        if (potential != NULL)
+        {
+            *potential += stack_energy[0];
+        }
+    }
+}
+
+/* Vector aceleración */
+inline void vector_acceleration(object objects, int i, vector_elem *forces, vector_elem *acceleration)
+{
+    /* Cálculo del vector aceleración */
+    acceleration->x = forces->x / objects.mass[i];
+    acceleration->y = forces->y/ objects.mass[i];
+    acceleration->z = forces->z / objects.mass[i];
+}
+
+/* Vector velocidad */
+inline void vector_speed(object *objects, int i, vector_elem *acceleration, double time_step)
+{
+    /* Cálculo del vector velocidad */
+    objects->speed_x[i] += (acceleration->x * time_step);
+    objects->speed_z[i] += (acceleration->z * time_step);
+    objects->speed_y[i] += (acceleration->y * time_step);
+    
+    /* 
+    //Version que usa sections
+    #pragma omp parallel
+    {
+        #pragma omp sections
+        {
+            #pragma omp section
+                objects->speed_x[i] += (acceleration->x * time_step);
+
+            #pragma omp section
+                objects->speed_z[i] += (acceleration->z * time_step);
+
+            #pragma omp section
+                objects->speed_y[i] += (acceleration->y * time_step);
+        }
+    }
+    */
+
+}
+
+/* Vector de posicion */
+inline void vector_position(object *objects, int i, double time_step)
+{
+    /* Cálculo del vector posición */
+    objects->pos_x[i] += (objects->speed_x[i] * time_step);
+    objects->pos_y[i] += (objects->speed_y[i] * time_step);
+    objects->pos_z[i] += (objects->speed_z[i] * time_step);
+    /*
+    // Version que usa sections 
+    #pragma omp parallel
+    {
+        #pragma omp sections
+        {
+            #pragma omp section
+                objects->pos_x[i] += (objects->speed_x[i] * time_step);
+
+            #pragma omp section
+                objects->pos_y[i] += (objects->speed_y[i] * time_step);
+
+            #pragma omp section
+                objects->pos_z[i] += (objects->speed_z[i] * time_step);
+        }
+    }
+    */
+}
+
+/* Función para recolocar al objeto si traspasa los límites */
+inline void check_border(object *objects, int i, double size_enclosure)
+{
+    // Checks posición x
+    if (objects->pos_x[i] <= 0)
+    {
+        objects->pos_x[i] = 0;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+    else if (objects->pos_x[i] >= size_enclosure)
+    {
+        objects->pos_x[i] = size_enclosure;
+        objects->speed_x[i] = -1 * (objects->speed_x[i]);
+    }
+
+    // Checks posición y
+    if (objects->pos_y[i] <= 0)
+    {
+        objects->pos_y[i] = 0;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+    else if (objects->pos_y[i] >= size_enclosure)
+    {
+        objects->pos_y[i] = size_enclosure;
+        objects->speed_y[i] = -1 * (objects->speed_y[i]);
+    }
+
+    // Checks posición z
+    if (objects->pos_z[i] <= 0)
+    {
+        objects->pos_z[i] = 0;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }
+    else if (objects->pos_z[i] >= size_enclosure)
+    {
+        objects->pos_z[i] = size_enclosure;
+        objects->speed_z[i] = -1 * (objects->speed_z[i]);
+    }      
+}
+
+/* Velocidad, posición y borde de una coordenada en una sola pasada: speed += acceleration * kick,
+   position += speed * drift y rebote en el borde. Las mismas operaciones en el mismo orden que vector_speed,
+   vector_position y check_border, pero el rebote se elige sin saltos (el compilador puede usar selecciones) */
+inline void kick_drift(double *position, double *speed, double acceleration, double kick, double drift, double size_enclosure)
+{
+    double v = *speed + acceleration * kick;
+    double p = *position + v * drift;
+    bool low = p <= 0;
+    bool high = p >= size_enclosure;
+    *speed = (low || high) ? -1 * v : v;
+    *position = low ? 0 : (high ? size_enclosure : p);
+}
+
+/* Integración fusionada del objeto i: una sola lectura y escritura de sus columnas por paso en vez de una por
+   bucle (velocidad, posición y bordes). Da los mismos resultados bit a bit que los bucles por separado */
+inline void integrate_body(object objects, int i, const vector_elem *acceleration, double kick, double drift, double size_enclosure)
+{
+    kick_drift(&objects.pos_x[i], &objects.speed_x[i], acceleration->x, kick, drift, size_enclosure);
+    kick_drift(&objects.pos_y[i], &objects.speed_y[i], acceleration->y, kick, drift, size_enclosure);
+    kick_drift(&objects.pos_z[i], &objects.speed_z[i], acceleration->z, kick, drift, size_enclosure);
+}
+
+/* Comprobar colisión entre dos objetos (distancia euclídea entre objetos menor que 1) */
+inline bool check_collision(object objects, int i, int j)
+{
+    if (euclidean_norm(objects, i, j) < 1)
+    {
+        return true;
+    }
+    return false;
+}
+
+/* Fusión de dos objetos que colisionan. Sobrevive el creado antes, así el resultado no depende del orden en memoria */
+inline void merge_objects(object objects, int i, int j)
+{
+    if (objects.id[j] < objects.id[i])
+    {
+        std::swap(i, j);
+    }
+    // Actualización de la masa y velocidades del primer objeto que colisiona generando uno nuevo
+    objects.mass[i] += objects.mass[j];
+    objects.speed_x[i] += objects.speed_x[j];
+    objects.speed_y[i] += objects.speed_y[j];
+    objects.speed_z[i] += objects.speed_z[j];
+
+    // Se "elimina" el objeto
+    objects.active[j]=false;
+}
+
+/* Comprobar colisiones entre todos los pares de objetos activos. Con options->reproducible los pares en contacto
+   se buscan en paralelo y se fusionan después en serie en el orden (i, j) del bucle en serie; si no, las filas
+   fusionan en paralelo y el orden de las fusiones encadenadas depende del reparto entre hilos.
+   Devuelve la menor distancia entre los pares comprobados que no colisionan (cota inferior de la distancia entre
+   los objetos que siguen activos, porque las fusiones no mueven a nadie) */
+inline double check_collisions(int num_objects, object objects, sim_options *options)
+{
+    double min_dist = std::numeric_limits<double>::infinity();
+    std::mutex lock;
+    if (options->reproducible)
+    {
+        // Las posiciones no cambian al fusionar, así que los pares en contacto no dependen del orden
+        std::vector<std::pair<int, int>> contacts;
+        parallel_pairs(options->backend, options->pool, num_objects, [&](int i) {
+            double row_min = std::numeric_limits<double>::infinity();
+            if(objects.active[i]==true){
+                for (int j = i + 1; j < num_objects; j++)
+                {
+                    if (objects.active[j]==true)
+                    {
+                        double dist = euclidean_norm(objects, i, j);
+                        if (dist < 1)
+                        {
+                            std::lock_guard<std::mutex> guard(lock);
+                            contacts.push_back({i, j});
+                        }
+                        else
+                        {
+                            row_min = std::min(row_min, dist);
+                        }
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            min_dist = std::min(min_dist, row_min);
+        });
+        std::sort(contacts.begin(), contacts.end());
+        for (const std::pair<int, int> &contact : contacts)
+        {
+            if(objects.active[contact.first]==true && objects.active[contact.second]==true){
+                merge_objects(objects, contact.first, contact.second);
+            }
+        }
+        return min_dist;
+    }
+    parallel_pairs(options->backend, options->pool, num_objects, [&](int i) {
+        double row_min = std::numeric_limits<double>::infinity();
+        for (int j = i + 1; j < num_objects; j++)
+        {
+            // Comprobar colisiones
+            if(objects.active[i]==true && objects.active[j]==true){
+            // Colision entre objetos diferentes que no hayan sido eliminados con anterioridad (check_collision)
+                double dist = euclidean_norm(objects, i, j);
+                if (dist < 1)
+                {
+                    merge_objects(objects, i, j);
+                }
+                else
+                {
+                    row_min = std::min(row_min, dist);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        min_dist = std::min(min_dist, row_min);
+    });
+    return min_dist;
+}
+
+/* Pasada de colisiones de una iteración con la comprobación elegida. Con ALL_PAIRS la pasada se salta si desde
+   la última pasada completa ningún objeto se ha desplazado lo suficiente para que un par llegue a distancia 1
+   (ver collision_schedule); el resultado es el mismo que si se hubiera hecho */
+inline void collision_pass(int num_objects, object objects, neighbour_list *list, collision_schedule *schedule, sim_options *options)
+{
+    if (options->collision == VERLET)
+    {
+        check_collisions_verlet(num_objects, objects, list, options->skin);
+        return;
+    }
+    schedule->passes++;
+    if (schedule->built && schedule->valid)
+    {
+        double max_displacement = 0;
+        #pragma omp parallel for reduction(max:max_displacement)
+        for (int i = 0; i < num_objects; i++)
+        {
+            if(objects.active[i]==true){
+                double dx = objects.pos_x[i] - schedule->ref_x[i];
+                double dy = objects.pos_y[i] - schedule->ref_y[i];
+                double dz = objects.pos_z[i] - schedule->ref_z[i];
+                max_displacement = std::max(max_displacement, std::sqrt(dx * dx + dy * dy + dz * dz));
+            }
+        }
+        if (2 * max_displacement < schedule->margin)
+        {
+            schedule->skipped++;
+            return;
+        }
+    }
+
+    double min_dist = check_collisions(num_objects, objects, options);
+    if (!schedule->built)
+    {
+        schedule->ref_x = (double*)malloc(sizeof(double)*num_objects);
+        schedule->ref_y = (double*)malloc(sizeof(double)*num_objects);
+        schedule->ref_z = (double*)malloc(sizeof(double)*num_objects);
+        schedule->built = true;
+    }
+    double extent = 0;
+    int alive = 0;
+    #pragma omp parallel for reduction(max:extent) reduction(+:alive)
+    for (int i = 0; i < num_objects; i++)
+    {
+        schedule->ref_x[i] = objects.pos_x[i];
+        schedule->ref_y[i] = objects.pos_y[i];
+        schedule->ref_z[i] = objects.pos_z[i];
+        extent = std::max({extent, std::fabs(objects.pos_x[i]), std::fabs(objects.pos_y[i]), std::fabs(objects.pos_z[i])});
+        alive += objects.active[i] == true;
+    }
+    // Tolerancia por el redondeo de las distancias, relativa a las coordenadas
+    schedule->margin = min_dist - 1 - COLLISION_TOLERANCE * (1 + extent);
+    // Sin ninguna distancia medida min_dist es infinito y el margen saltaría todas las pasadas siguientes. Solo
+    // es correcto si queda como mucho un objeto activo; si no (p. ej. todos los pares medidos se han fusionado o
+    // hay coordenadas NaN) la siguiente pasada se hace completa
+    schedule->valid = std::isfinite(min_dist) || alive <= 1;
+}
+
+/* Construye las listas de vecinos: pares activos a menos de 1 + skin */
+inline void build_neighbour_list(int num_objects, object objects, neighbour_list *list, double skin)
+{
+    if (!list->built)
+    {
+        list->start = (int*)malloc(sizeof(int)*(num_objects + 1));
+        list->ref_x = (double*)malloc(sizeof(double)*num_objects);
+        list->ref_y = (double*)malloc(sizeof(double)*num_objects);
+        list->ref_z = (double*)malloc(sizeof(double)*num_objects);
+        list->built = true;
+    }
+
+    /* Número de vecinos de cada objeto */
+    list->start[0] = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_objects; i++)
+    {
+        int count = 0;
+        if(objects.active[i]==true){
+            for (int j = i + 1; j < num_objects; j++)
+            {
+                if(objects.active[j]==true && euclidean_norm(objects, i, j) < 1 + skin){
+                    count++;
+                }
+            }
+        }
+        list->start[i + 1] = count;
+        list->ref_x[i] = objects.pos_x[i];
+        list->ref_y[i] = objects.pos_y[i];
+        list->ref_z[i] = objects.pos_z[i];
+    }
+
+    /* Suma prefija para obtener el inicio de cada lista */
+    int active_objects = 0;
+    for (int i = 0; i < num_objects; i++)
+    {
+        list->start[i + 1] += list->start[i];
+        active_objects += objects.active[i];
+    }
+    if (list->start[num_objects] > list->capacity)
+    {
+        list->capacity = 2 * (long)list->start[num_objects];
+        list->neighbours = (int*)realloc(list->neighbours, sizeof(int)*list->capacity);
+    }
+
+    /* Relleno de las listas, cada objeto en su tramo */
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_objects; i++)
+    {
+        int next = list->start[i];
+        if(objects.active[i]==true){
+            for (int j = i + 1; j < num_objects; j++)
+            {
+                if(objects.active[j]==true && euclidean_norm(objects, i, j) < 1 + skin){
+                    list->neighbours[next++] = j;
+                }
+            }
+        }
+    }
+
+    list->valid = true;
+    list->rebuilds++;
+    list->total_length += list->start[num_objects];
+    list->total_objects += active_objects;
+}
+
+/* Colisiones usando las listas de vecinos. Se reconstruyen cuando algún objeto se ha desplazado más de skin/2
+   desde la última construcción: ningún par fuera de la lista puede haberse acercado a menos de 1 */
+inline void check_collisions_verlet(int num_objects, object objects, neighbour_list *list, double skin)
+{
+    double max_displacement = 0;
+    if (list->built)
+    {
+        #pragma omp parallel for reduction(max:max_displacement)
+        for (int i = 0; i < num_objects; i++)
+        {
+            if(objects.active[i]==true){
+                double dx = objects.pos_x[i] - list->ref_x[i];
+                double dy = objects.pos_y[i] - list->ref_y[i];
+                double dz = objects.pos_z[i] - list->ref_z[i];
+                max_displacement = std::max(max_displacement, std::sqrt(dx * dx + dy * dy + dz * dz));
+            }
+        }
+    }
+    if (!list->built || !list->valid || max_displacement > skin / 2)
+    {
+        build_neighbour_list(num_objects, objects, list, skin);
+    }
+    list->passes++;
+
+    /* Recorrido de las listas en el mismo orden que el bucle anidado sobre todos los pares */
+    for (int i = 0; i < num_objects; i++)
+    {
+        for (int k = list->start[i]; k < list->start[i + 1] && objects.active[i]==true; k++)
+        {
+            int j = list->neighbours[k];
+            if(objects.active[j]==true && check_collision(objects, i, j)){
+                merge_objects(objects, i, j);
+            }
+        }
+    }
+}
+
+/* Celda de un objeto (las posiciones están dentro del recinto tras check_border) */
+inline int cell_of(object objects, int i, cell_list *cells)
+{
+    int x = std::min(cells->per_dim - 1, std::max(0, (int)(objects.pos_x[i] / cells->cell_size)));
+    int y = std::min(cells->per_dim - 1, std::max(0, (int)(objects.pos_y[i] / cells->cell_size)));
+    int z = std::min(cells->per_dim - 1, std::max(0, (int)(objects.pos_z[i] / cells->cell_size)));
+    return (x * cells->per_dim + y) * cells->per_dim + z;
+}
+
+/* Construye la lista de celdas con una ordenación por recuento paralela y estable (como radix_sort).
+   El número de celdas se limita a unas num_objects para que la memoria y el recorrido sean O(N) */
+inline void build_cell_list(int num_objects, object objects, cell_list *cells, double size_enclosure, double cutoff)
+{
+    int per_dim = std::max(1, std::min((int)(size_enclosure / cutoff), (int)std::cbrt((double)num_objects) + 1));
+    long total = (long)per_dim * per_dim * per_dim;
+    cells->per_dim = per_dim;
+    cells->cell_size = size_enclosure / per_dim;
+    if (total + 1 > cells->cell_capacity)
+    {
+        cells->cell_capacity = total + 1;
+        cells->cell_start = (int*)realloc(cells->cell_start, sizeof(int)*cells->cell_capacity);
+    }
+    if (num_objects > cells->object_capacity)
+    {
+        cells->object_capacity = num_objects;
+        cells->cell_objects = (int*)realloc(cells->cell_objects, sizeof(int)*num_objects);
+        cells->object_cell = (int*)realloc(cells->object_cell, sizeof(int)*num_objects);
+    }
+
+    // El histograma se conserva entre evaluaciones: solo crece si aumentan las celdas o los hilos
+    int num_threads = omp_get_max_threads();
+    if (total * num_threads > cells->histogram_capacity)
+    {
+        cells->histogram_capacity = total * num_threads;
+        cells->histogram = (int*)realloc(cells->histogram, sizeof(int)*cells->histogram_capacity);
+    }
+    int *histogram = cells->histogram;
+    #pragma omp parallel num_threads(num_threads)
+    {
+        // El equipo puede tener menos hilos de los pedidos (regiones anidadas, sim-ensemble): tramos según su tamaño
+        int team = omp_get_num_threads();
+        int thread = omp_get_thread_num();
+        int *count = &histogram[total * thread];
+        int begin = (long)num_objects * thread / team;
+        int end = (long)num_objects * (thread + 1) / team;
+
+        /* Celda de cada objeto y recuento por celda en el tramo de cada hilo */
+        for (long c = 0; c < total; c++) count[c] = 0;
+        for (int k = begin; k < end; k++)
+        {
+            cells->object_cell[k] = objects.active[k]==true ? cell_of(objects, k, cells) : -1;
+            if (cells->object_cell[k] >= 0) count[cells->object_cell[k]]++;
+        }
+        #pragma omp barrier
+
+        /* Posiciones de salida: por celda y, dentro de cada celda, por hilo (estable) */
+        #pragma omp single
+        {
+            int offset = 0;
+            for (long c = 0; c < total; c++)
+            {
+                cells->cell_start[c] = offset;
+                for (int t = 0; t < team; t++)
+                {
+                    int n = histogram[total * t + c];
+                    histogram[total * t + c] = offset;
+                    offset += n;
+                }
+            }
+            cells->cell_start[total] = offset;
+        }
+
+        for (int k = begin; k < end; k++)
+        {
+            if (cells->object_cell[k] >= 0) cells->cell_objects[count[cells->object_cell[k]]++] = k;
+        }
+    }
+}
+
+/* Fuerza de corte sobre el objeto i: pares a menos de cutoff en las 27 celdas vecinas, con suavizado de Plummer.
+   Si potential no es NULL se le suma la mitad del potencial suavizado y desplazado de sus pares (como total_energy) */
+inline void calc_gravitational_cutoff(int i, object objects, cell_list *cells, sim_options *options, vector_elem *forces, double *potential)
+{
+    int per_dim = cells->per_dim;
+    int c = cells->object_cell[i];
+    int cx = c / (per_dim * per_dim);
+    int cy = (c / per_dim) % per_dim;
+    int cz = c % per_dim;
+    double cutoff2 = options->cutoff * options->cutoff;
+    double softening2 = options->softening * options->softening;
+    double shift = 1 / std::sqrt(cutoff2 + softening2);
+    for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, per_dim - 1); x++)
+    {
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, per_dim - 1); y++)
+        {
+            for (int z = std::max(cz - 1, 0); z <= std::min(cz + 1, per_dim - 1); z++)
+            {
+                int cell = (x * per_dim + y) * per_dim + z;
+                for (int k = cells->cell_start[cell]; k < cells->cell_start[cell + 1]; k++)
+                {
+                    int j = cells->cell_objects[k];
+                    double dx = objects.pos_x[j] - objects.pos_x[i];
+                    double dy = objects.pos_y[j] - objects.pos_y[i];
+                    double dz = objects.pos_z[j] - objects.pos_z[i];
+                    double dist2 = dx * dx + dy * dy + dz * dz;
+                    if (j != i && dist2 < cutoff2)
+                    {
+                        double soft2 = dist2 + softening2;
+                        double Fg = GRAVITY_CONST * objects.mass[j] * objects.mass[i] / (soft2 * std::sqrt(soft2));
+                        forces->x += Fg * dx;
+                        forces->y += Fg * dy;
+                        forces->z += Fg * dz;
+                        if (potential != NULL)
+                        {
+                            *potential -= 0.5 * GRAVITY_CONST * objects.mass[i] * objects.mass[j] * (1 / std::sqrt(soft2) - shift);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* FFT compleja radix-2 iterativa (Cooley-Tukey) in situ de una línea de n = 2^k puntos. La inversa no divide por n */
+inline void fft_1d(std::complex<double> *line, int n, bool inverse)
+{
+    /* Permutación de inversión de bits */
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(line[i], line[j]);
+        }
+    }
+    /* Mariposas */
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        double angle = 2 * M_PI / length * (inverse ? 1 : -1);
+        std::complex<double> root(cos(angle), sin(angle));
+        for (int start = 0; start < n; start += length)
+        {
+            std::complex<double> w(1, 0);
+            for (int k = 0; k < length / 2; k++)
+            {
+                std::complex<double> even = line[start + k];
+                std::complex<double> odd = line[start + k + length / 2] * w;
+                line[start + k] = even + odd;
+                line[start + k + length / 2] = even - odd;
+                w *= root;
+            }
+        }
+    }
+}
+
+/* FFT 3D de n^3 puntos (índice (x * n + y) * n + z): FFT 1D sobre cada eje, con las líneas repartidas entre hilos.
+   Las líneas de los ejes x e y se copian a un buffer contiguo del hilo. La inversa divide por n^3 */
+inline void fft_3d(std::complex<double> *data, int n, bool inverse)
+{
+    long n2 = (long)n * n;
+    #pragma omp parallel
+    {
+        std::complex<double> *line = (std::complex<double>*)malloc(sizeof(std::complex<double>)*n);
+        // Eje z (contiguo)
+        #pragma omp for schedule(static)
+        for (long xy = 0; xy < n2; xy++)
+        {
+            fft_1d(&data[xy * n], n, inverse);
+        }
+        // Eje y
+        #pragma omp for schedule(static)
+        for (long xz = 0; xz < n2; xz++)
+        {
+            long base = (xz / n) * n2 + xz % n;
+            for (int k = 0; k < n; k++) line[k] = data[base + k * (long)n];
+            fft_1d(line, n, inverse);
+            for (int k = 0; k < n; k++) data[base + k * (long)n] = line[k];
+        }
+        // Eje x
+        #pragma omp for schedule(static)
+        for (long yz = 0; yz < n2; yz++)
+        {
+            for (int k = 0; k < n; k++) line[k] = data[yz + k * n2];
+            fft_1d(line, n, inverse);
+            for (int k = 0; k < n; k++) data[yz + k * n2] = line[k];
+        }
+        free(line);
+    }
+    if (inverse)
+    {
+        double scale = 1.0 / ((double)n2 * n);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < n2 * n; k++)
+        {
+            data[k] *= scale;
+        }
+    }
+}
+
+/* Pesos CIC (cloud-in-cell) en una dimensión: las dos celdas más cercanas al centro de celda (k + 1/2) * spacing.
+   En los bordes el peso que caería fuera del recinto se queda en la última celda */
+inline void cic_weights(double position, double spacing, int size, int *index, double *weight)
+{
+    double u = position / spacing - 0.5;
+    int low = (int)floor(u);
+    double frac = u - low;
+    index[0] = std::min(std::max(low, 0), size - 1);
+    index[1] = std::min(std::max(low + 1, 0), size - 1);
+    weight[0] = 1 - frac;
+    weight[1] = frac;
+}
+
+/* Reserva la malla y calcula la transformada de la función de Green con condiciones aisladas */
+inline void pm_init(pm_grid *pm, double size_enclosure, int size)
+{
+    int n = 2 * size;
+    long cells = (long)n * n * n;
+    long inner = (long)size * size * size;
+    pm->size = size;
+    pm->spacing = size_enclosure / size;
+    pm->density = (std::complex<double>*)malloc(sizeof(std::complex<double>)*cells);
+    pm->green = (double*)malloc(sizeof(double)*cells);
+    pm->accel_x = (double*)malloc(sizeof(double)*inner);
+    pm->accel_y = (double*)malloc(sizeof(double)*inner);
+    pm->accel_z = (double*)malloc(sizeof(double)*inner);
+
+    /* -G/r con la distancia mínima en la malla periódica de 2G (la mitad de la malla es el relleno de ceros).
+       En r = 0 se usa la distancia media de una celda a su centro, spacing / 2 */
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < cells; k++)
+    {
+        long x = k / ((long)n * n);
+        long y = (k / n) % n;
+        long z = k % n;
+        double dx = std::min(x, n - x) * pm->spacing;
+        double dy = std::min(y, n - y) * pm->spacing;
+        double dz = std::min(z, n - z) * pm->spacing;
+        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        pm->density[k] = -GRAVITY_CONST / (k == 0 ? pm->spacing / 2 : dist);
+    }
+    fft_3d(pm->density, n, false);
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < cells; k++)
+    {
+        pm->green[k] = pm->density[k].real();
+    }
+    pm->built = true;
+}
+
+/* Resuelve la malla: reparto CIC de la masa, potencial por convolución con FFT y aceleración en cada celda
+   con diferencias centradas del potencial (laterales en los bordes). Con reproducible el reparto es en serie
+   (las sumas atómicas de varios hilos en una celda no tienen orden fijo) */
+inline void pm_solve(int num_objects, object objects, pm_grid *pm, bool reproducible)
+{
+    int size = pm->size;
+    int n = 2 * size;
+    long cells = (long)n * n * n;
+    double spacing = pm->spacing;
+
+    /* Reparto de la masa (CIC) */
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < cells; k++)
+    {
+        pm->density[k] = 0;
+    }
+    #pragma omp parallel for schedule(static) if(!reproducible)
+    for (int i = 0; i < num_objects; i++)
+    {
+        if(objects.active[i]==true){
+            int ix[2], iy[2], iz[2];
+            double wx[2], wy[2], wz[2];
+            cic_weights(objects.pos_x[i], spacing, size, ix, wx);
+            cic_weights(objects.pos_y[i], spacing, size, iy, wy);
+            cic_weights(objects.pos_z[i], spacing, size, iz, wz);
+            for (int a = 0; a < 2; a++)
+            {
+                for (int b = 0; b < 2; b++)
+                {
+                    for (int c = 0; c < 2; c++)
+                    {
+                        double *cell = reinterpret_cast<double*>(&pm->density[((long)ix[a] * n + iy[b]) * n + iz[c]]);
+                        #pragma omp atomic
+                        cell[0] += objects.mass[i] * wx[a] * wy[b] * wz[c];
+                    }
+                }
+            }
+        }
+    }
+
+    /* Potencial: convolución con la función de Green */
+    fft_3d(pm->density, n, false);
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < cells; k++)
+    {
+        pm->density[k] *= pm->green[k];
+    }
+    fft_3d(pm->density, n, true);
+
+    /* Aceleración -grad(potencial) en las celdas del recinto */
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < (long)size * size * size; k++)
+    {
+        int x = k / ((long)size * size);
+        int y = (k / size) % size;
+        int z = k % size;
+        int xl = std::max(x - 1, 0), xh = std::min(x + 1, size - 1);
+        int yl = std::max(y - 1, 0), yh = std::min(y + 1, size - 1);
+        int zl = std::max(z - 1, 0), zh = std::min(z + 1, size - 1);
+        auto phi = [pm, n](int a, int b, int c) { return pm->density[((long)a * n + b) * n + c].real(); };
+        pm->accel_x[k] = -(phi(xh, y, z) - phi(xl, y, z)) / ((xh - xl) * spacing);
+        pm->accel_y[k] = -(phi(x, yh, z) - phi(x, yl, z)) / ((yh - yl) * spacing);
+        pm->accel_z[k] = -(phi(x, y, zh) - phi(x, y, zl)) / ((zh - zl) * spacing);
+    }
+}
+
+/* Fuerza de PM sobre el objeto i: aceleración de la malla interpolada con los mismos pesos CIC por la masa.
+   Si potential no es NULL se le suma la mitad de la masa por el potencial de la malla interpolado (incluye la
+   autoenergía del propio objeto en la malla, casi constante) */
+inline void pm_force(int i, object objects, pm_grid *pm, vector_elem *forces, double *potential)
+{
+    int size = pm->size;
+    int ix[2], iy[2], iz[2];
+    double wx[2], wy[2], wz[2];
+    cic_weights(objects.pos_x[i], pm->spacing, size, ix, wx);
+    cic_weights(objects.pos_y[i], pm->spacing, size, iy, wy);
+    cic_weights(objects.pos_z[i], pm->spacing, size, iz, wz);
+    for (int a = 0; a < 2; a++)
+    {
+        for (int b = 0; b < 2; b++)
+        {
+            for (int c = 0; c < 2; c++)
+            {
+                long k = ((long)ix[a] * size + iy[b]) * size + iz[c];
+                double w = wx[a] * wy[b] * wz[c] * objects.mass[i];
+                forces->x += w * pm->accel_x[k];
+                forces->y += w * pm->accel_y[k];
+                forces->z += w * pm->accel_z[k];
+                if (potential != NULL)
+                {
+                    long n = 2 * size;
+                    *potential += 0.5 * w * pm->density[((long)ix[a] * n + iy[b]) * n + iz[c]].real();
+                }
+            }
+        }
+    }
+}
+
+/* Prepara las estructuras del cálculo de fuerzas con las posiciones actuales (antes de cada evaluación) */
+inline void prepare_forces(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options)
+{
+    if (options->force == CUTOFF)
+    {
+        build_cell_list(num_objects, objects, &field->cells, size_enclosure, options->cutoff);
+    }
+    else if (options->force == PM)
+    {
+        if (!field->pm.built)
+        {
+            pm_init(&field->pm, size_enclosure, options->pm_grid);
+        }
+        pm_solve(num_objects, objects, &field->pm, options->reproducible);
+    }
+}
+
+/* Fuerza gravitatoria sobre el objeto i con el cálculo elegido (forces debe estar a cero).
+   Con potential se acumula además su parte de la energía potencial */
+inline void calc_force(int num_objects, int i, object objects, force_field *field, sim_options *options, vector_elem *forces, double *potential)
+{
+    if (options->force == CUTOFF)
+    {
+        calc_gravitational_cutoff(i, objects, &field->cells, options, forces, potential);
+    }
+    else if (options->force == PM)
+    {
+        pm_force(i, objects, &field->pm, forces, potential);
+    }
+    else if (options->reproducible)
+    {
+        calc_gravitational_reproducible(num_objects, i, objects, forces, potential);
+    }
+    else if (options->rsqrt > 0)
+    {
+        calc_gravitational_rsqrt(0, num_objects, i, objects, options->rsqrt, forces, potential);
+    }
+    else
+    {
+        calc_gravitational(num_objects, i, objects, forces, potential);
+    }
+}
+
+/* Suma directa por bloques: cada hilo toma tile objetos y recorre los demás de tile en tile, así el bloque
+   de objetos j se reutiliza desde la caché para todo el bloque i. Cada objeto suma sus pares en el mismo orden
+   que calc_gravitational, así que las fuerzas son idénticas. Con --rsqrt cada bloque j se suma con
+   calc_gravitational_rsqrt, así que el redondeo depende de tile */
+inline void calc_gravitational_tiled(int num_objects, object objects, sim_options *options, vector_elem *forces, double *potential)
+{
+    int tile = options->tile;
+    int rsqrt = options->rsqrt;
+    int blocks = (num_objects + tile - 1) / tile;
+    double total = parallel_sum(options->backend, options->pool, blocks, 1, true, [&](int block) {
+        double energy = 0;
+        int i0 = block * tile;
+        int i1 = std::min(i0 + tile, num_objects);
+        for (int i = i0; i < i1; i++)
+        {
+            forces[i].x = 0;
+            forces[i].y = 0;
+            forces[i].z = 0;
+        }
+        for (int j0 = 0; j0 < num_objects; j0 += tile)
+        {
+            int j1 = std::min(j0 + tile, num_objects);
+            for (int i = i0; i < i1; i++)
+            {
+                if(objects.active[i]==true && rsqrt > 0){
+                    calc_gravitational_rsqrt(j0, j1, i, objects, rsqrt, &forces[i], potential != NULL ? &energy : NULL);
+                }
+                else if(objects.active[i]==true){
+                    for (int j = j0; j < j1; j++)
+                    {
+                        if (j != i && objects.active[j]==true){
+                            double dist = vector_gravitational_force(objects, j, i, &forces[i]);
+                            if (potential != NULL)
+                            {
+                                energy -= 0.5 * GRAVITY_CONST * objects.mass[i] * objects.mass[j] / dist;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return energy;
+    });
+    if (potential != NULL)
+    {
+        *potential = total;
+    }
+}
+
+/* Si el bucle de fuerzas por objeto va en paralelo (calc_forces y pasos por bloques): la suma directa se
+   mantiene en serie salvo con tile (bloques en paralelo) o reproducible */
+inline bool parallel_forces(const sim_options *options)
+{
+    return options->force != DIRECT || options->tile > 0 || options->reproducible;
+}
+
+/* Fuerzas de todos los objetos activos (una evaluación de fuerzas). La suma directa se mantiene en serie salvo
+   con options->tile o options->reproducible; con CUTOFF y PM cada objeto es independiente y el bucle es paralelo.
+   Si potential no es NULL se deja en él la energía potencial total, calculada en la misma pasada (con
+   options->reproducible, sumada con un árbol fijo) */
+inline void calc_forces(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options, vector_elem *forces, double *potential)
+{
+    bool parallel = parallel_forces(options);
+    if (options->force == DIRECT && options->tile > 0 && !options->reproducible)
+    {
+        calc_gravitational_tiled(num_objects, objects, options, forces, potential);
+        return;
+    }
+    prepare_forces(num_objects, objects, field, size_enclosure, options);
+    if (potential == NULL)
+    {
+        parallel_bodies(options->backend, options->pool, num_objects, 64, parallel, [&](int i) {
+            if(objects.active[i]==true){
+                forces[i].x = 0;
+                forces[i].y = 0;
+                forces[i].z = 0;
+                calc_force(num_objects, i, objects, field, options, &forces[i]);
+            }
+        });
+        return;
+    }
+    auto body = [&](int i) {
+        double energy = 0;
+        if(objects.active[i]==true){
+            forces[i].x = 0;
+            forces[i].y = 0;
+            forces[i].z = 0;
+            calc_force(num_objects, i, objects, field, options, &forces[i], &energy);
+        }
+        return energy;
+    };
+    if (options->reproducible)
+    {
+        *potential = reproducible_sum(options->backend, options->pool, num_objects, 64, parallel, body);
+    }
+    else
+    {
+        *potential = parallel_sum(options->backend, options->pool, num_objects, 64, parallel, body);
+    }
+}
+
+/* Fuerzas y aceleraciones de todos los objetos activos (una evaluación de fuerzas) */
+inline void calc_accelerations(int num_objects, object objects, force_field *field, double size_enclosure, sim_options *options, vector_elem *forces, vector_elem *acceleration, double *potential)
+{
+    calc_forces(num_objects, objects, field, size_enclosure, options, forces, potential);
+    parallel_bodies(options->backend, options->pool, num_objects, 1024, true, [&](int i) {
+        if(objects.active[i]==true){
+            vector_acceleration(objects, i, &forces[i], &acceleration[i]);
+        }
+    });
+}
+
+/* Energía total: cinética más potencial gravitatoria de todos los pares de objetos activos.
+   Con CUTOFF el potencial es el suavizado, desplazado para anularse en cutoff y nulo más allá.
+   Con options->reproducible la energía de cada objeto (con sus pares j > i) se suma con un árbol fijo */
+inline double total_energy(int num_objects, object objects, const sim_options *options)
+{
+    double softening2 = options->softening * options->softening;
+    double shift = 1 / std::sqrt(options->cutoff * options->cutoff + softening2);
+    auto energy_of = [&](int i) {
+        double energy = 0;
+        if(objects.active[i]==true){
+            energy += 0.5 * objects.mass[i] * (objects.speed_x[i] * objects.speed_x[i] + objects.speed_y[i] * objects.speed_y[i] + objects.speed_z[i] * objects.speed_z[i]);
+            for (int j = i + 1; j < num_objects; j++)
+            {
+                if(objects.active[j]==true && options->force == CUTOFF){
+                    double dist = euclidean_norm(objects, i, j);
+                    if (dist < options->cutoff)
+                    {
+                        energy -= GRAVITY_CONST * objects.mass[i] * objects.mass[j] * (1 / std::sqrt(dist * dist + softening2) - shift);
+                    }
+                }
+                else if(objects.active[j]==true){
+                    energy -= GRAVITY_CONST * objects.mass[i] * objects.mass[j] / euclidean_norm(objects, i, j);
+                }
+            }
+        }
+        return energy;
+    };
+    if (options->reproducible)
+    {
+        return reproducible_sum(options->backend, options->pool, num_objects, 1, true, energy_of);
+    }
+    double energy = 0;
+    #pragma omp parallel for reduction(+:energy) schedule(dynamic)
+    for (int i = 0; i < num_objects; i++)
+    {
+        energy += energy_of(i);
+    }
+    return energy;
+}
+
+/* Energía cinética, momento lineal y momento angular de los objetos activos (reducciones paralelas, O(N);
+   en serie con reproducible) */
+inline void conserved_quantities(int num_objects, object objects, monitor_sample *sample, bool reproducible)
+{
+    double kinetic = 0;
+    double px = 0, py = 0, pz = 0;
+    double lx = 0, ly = 0, lz = 0;
+    #pragma omp parallel for schedule(static) reduction(+:kinetic, px, py, pz, lx, ly, lz) if(!reproducible)
+    for (int i = 0; i < num_objects; i++)
+    {
+        if(objects.active[i]==true){
+            double mvx = objects.mass[i] * objects.speed_x[i];
+            double mvy = objects.mass[i] * objects.speed_y[i];
+            double mvz = objects.mass[i] * objects.speed_z[i];
+            kinetic += 0.5 * (mvx * objects.speed_x[i] + mvy * objects.speed_y[i] + mvz * objects.speed_z[i]);
+            px += mvx;
+            py += mvy;
+            pz += mvz;
+            lx += objects.pos_y[i] * mvz - objects.pos_z[i] * mvy;
+            ly += objects.pos_z[i] * mvx - objects.pos_x[i] * mvz;
+            lz += objects.pos_x[i] * mvy - objects.pos_y[i] * mvx;
+        }
+    }
+    sample->kinetic = kinetic;
+    sample->momentum = {px, py, pz};
+    sample->angular = {lx, ly, lz};
+}
+
+/* Separa los 21 bits bajos de value dejando dos ceros entre cada bit */
+inline uint64_t spread_bits(uint64_t value)
+{
+    value &= 0x1fffff;
+    value = (value | value << 32) & 0x1f00000000ffff;
+    value = (value | value << 16) & 0x1f0000ff0000ff;
+    value = (value | value << 8) & 0x100f00f00f00f00f;
+    value = (value | value << 4) & 0x10c30c30c30c30c3;
+    value = (value | value << 2) & 0x1249249249249249;
+    return value;
+}
+
+/* Código Morton (orden Z) de 63 bits de la posición de un objeto dentro del recinto */
+inline uint64_t morton_code(object objects, int i, double size_enclosure)
+{
+    const double scale = (double)((1 << 21) - 1) / size_enclosure;
+    uint64_t x = (uint64_t)(std::min(std::max(objects.pos_x[i], 0.0), size_enclosure) * scale);
+    uint64_t y = (uint64_t)(std::min(std::max(objects.pos_y[i], 0.0), size_enclosure) * scale);
+    uint64_t z = (uint64_t)(std::min(std::max(objects.pos_z[i], 0.0), size_enclosure) * scale);
+    return spread_bits(x) << 2 | spread_bits(y) << 1 | spread_bits(z);
+}
+
+/* Ordenación radix LSD paralela y estable de keys (con su índice), 8 bits por pasada. counts guarda el
+   histograma por hilo entre llamadas */
+inline void radix_sort(uint64_t *keys, int *index, int n, uint64_t *keys_tmp, int *index_tmp, std::vector<int> *counts)
+{
+    uint64_t *sorted_keys = keys;
+    int *sorted_index = index;
+    // El histograma es del llamante y se conserva entre ordenaciones: solo crece si aumentan los hilos
+    int num_threads = omp_get_max_threads();
+    if (counts->size() < (size_t)256 * num_threads)
+    {
+        counts->resize((size_t)256 * num_threads);
+    }
+    int *histogram = counts->data();
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        bool skip = false;
+        #pragma omp parallel num_threads(num_threads)
+        {
+            // El equipo puede tener menos hilos de los pedidos (regiones anidadas, sim-ensemble): tramos según su tamaño
+            int team = omp_get_num_threads();
+            int thread = omp_get_thread_num();
+            int *count = &histogram[256 * thread];
+            int begin = (long)n * thread / team;
+            int end = (long)n * (thread + 1) / team;
+
+            /* Histograma del dígito en el tramo de cada hilo */
+            for (int d = 0; d < 256; d++) count[d] = 0;
+            for (int k = begin; k < end; k++) count[(keys[k] >> shift) & 0xff]++;
+            #pragma omp barrier
+
+            /* Posiciones de salida: por dígito y, dentro de cada dígito, por hilo (estable) */
+            #pragma omp single
+            {
+                int offset = 0;
+                for (int d = 0; d < 256; d++)
+                {
+                    int digit_total = 0;
+                    for (int t = 0; t < team; t++)
+                    {
+                        int c = histogram[256 * t + d];
+                        histogram[256 * t + d] = offset;
+                        offset += c;
+                        digit_total += c;
+                    }
+                    // Si todas las claves comparten el dígito la pasada no cambia el orden
+                    skip = skip || digit_total == n;
+                }
+            }
+
+            if (!skip)
+            {
+                for (int k = begin; k < end; k++)
+                {
+                    int dst = count[(keys[k] >> shift) & 0xff]++;
+                    keys_tmp[dst] = keys[k];
+                    index_tmp[dst] = index[k];
+                }
+            }
+        }
+        if (!skip)
+        {
+            std::swap(keys, keys_tmp);
+            std::swap(index, index_tmp);
+        }
+    }
+
+    /* Tras un número impar de pasadas efectivas el resultado está en los vectores temporales del llamante */
+    if (keys != sorted_keys)
+    {
+        memcpy(sorted_keys, keys, sizeof(uint64_t)*n);
+        memcpy(sorted_index, index, sizeof(int)*n);
+    }
+}
+
+/* Aplica la permutación index a una columna usando scratch como almacenamiento temporal */
+template <class T>
+void permute(T *column, int *index, int n, void *scratch)
+{
+    if (column == NULL)
+    {
+        return;
+    }
+    T *tmp = (T*)scratch;
+    #pragma omp parallel for
+    for (int k = 0; k < n; k++)
+    {
+        tmp[k] = column[index[k]];
+    }
+    memcpy(column, tmp, sizeof(T)*n);
+}
+
+/* Ordena todas las columnas por el código Morton de la posición. Los objetos eliminados quedan al final y se
+   descartan; devuelve el nuevo número de objetos */
+inline int morton_reorder(int num_objects, object objects, vector_elem *acceleration, int *level, double size_enclosure, arena *scratch, std::vector<int> *histogram)
+{
+    uint64_t *keys = arena_array<uint64_t>(scratch, num_objects);
+    uint64_t *keys_tmp = arena_array<uint64_t>(scratch, num_objects);
+    int *index = arena_array<int>(scratch, num_objects);
+    int *index_tmp = arena_array<int>(scratch, num_objects);
+    void *column_tmp = arena_array<vector_elem>(scratch, num_objects);
+
+    int active_objects = 0;
+    #pragma omp parallel for reduction(+:active_objects)
+    for (int i = 0; i < num_objects; i++)
+    {
+        keys[i] = objects.active[i]==true ? morton_code(objects, i, size_enclosure) : UINT64_MAX;
+        index[i] = i;
+        active_objects += objects.active[i];
+    }
+
+    radix_sort(keys, index, num_objects, keys_tmp, index_tmp, histogram);
+
+    permute(objects.pos_x, index, active_objects, column_tmp);
+    permute(objects.pos_y, index, active_objects, column_tmp);
+    permute(objects.pos_z, index, active_objects, column_tmp);
+    permute(objects.speed_x, index, active_objects, column_tmp);
+    permute(objects.speed_y, index, active_objects, column_tmp);
+    permute(objects.speed_z, index, active_objects, column_tmp);
+    permute(objects.mass, index, active_objects, column_tmp);
+    permute(objects.active, index, active_objects, column_tmp);
+    permute(objects.id, index, active_objects, column_tmp);
+    permute(acceleration, index, active_objects, column_tmp);
+    permute(level, index, active_objects, column_tmp);
+    return active_objects;
+}
+
+/* Nivel del paso individual: el menor k tal que 1/2 |a| (time_step/2^k)^2 <= block_eta */
+inline int block_level(vector_elem *acceleration, double time_step, sim_options *options)
+{
+    double norm = std::sqrt(acceleration->x * acceleration->x + acceleration->y * acceleration->y + acceleration->z * acceleration->z);
+    int k = 0;
+    double dt = time_step;
+    while (k < options->block_levels && 0.5 * norm * dt * dt > options->block_eta)
+    {
+        k++;
+        dt /= 2;
+    }
+    return k;
+}
+
+/* Un paso de time_step con pasos individuales por bloques (leapfrog kick-drift-kick).
+   Un objeto de nivel k avanza time_step/2^k (2^(block_levels - k) subpasos de time_step/2^block_levels). Solo se
+   visitan los subpasos en los que algún objeto empieza o termina su paso, así que el subpaso efectivo es el del
+   nivel más profundo en uso y se reajusta cuando cambian los niveles. Todos los objetos se desplazan hasta el
+   siguiente subpaso visitado y solo los que terminan su paso recalculan fuerzas. Las colisiones se comprueban en
+   cada subpaso visitado antes de las fuerzas, como en leapfrog. Devuelve las interacciones calculadas y suma a
+   global_evaluations las de un paso leapfrog de time_step */
+inline long block_step(int num_objects, object objects, int *level, vector_elem *forces, vector_elem *acceleration, neighbour_list *list, collision_schedule *schedule, force_field *field, double time_step, double size_enclosure, sim_options *options, long *global_evaluations)
+{
+    long ticks = 1L << options->block_levels; // Subpasos de time_step/ticks del nivel más profundo posible
+    double dt_min = time_step / ticks;
+    long evaluations = 0;
+
+    int alive = 0;
+    for (int i = 0; i < num_objects; i++)
+    {
+        alive += objects.active[i];
+    }
+    *global_evaluations += (long)alive * (alive - 1);
+
+    long next;
+    for (long tick = 0; tick < ticks; tick = next)
+    {
+        /* Siguiente subpaso visitado: el primer final de paso de algún objeto activo */
+        next = ticks;
+        for (int i = 0; i < num_objects; i++)
+        {
+            long step = 1L << (options->block_levels - level[i]);
+            if(objects.active[i]==true){
+                next = std::min(next, (tick / step + 1) * step);
+            }
+        }
+
+        /* Medio impulso de apertura de los objetos que empiezan su paso */
+        parallel_bodies(options->backend, options->pool, num_objects, 1024, true, [&](int i) {
+            long step = 1L << (options->block_levels - level[i]);
+            if(objects.active[i]==true && tick % step == 0){
+                vector_speed(&objects, i, &acceleration[i], dt_min * step / 2);
+            }
+        });
+
+        /* Todos los objetos avanzan hasta el siguiente subpaso visitado */
+        parallel_bodies(options->backend, options->pool, num_objects, 1024, true, [&](int i) {
+            if(objects.active[i]==true){
+                vector_position(&objects, i, dt_min * (next - tick));
+                check_border(&objects, i, size_enclosure);
+            }
+        });
+
+        /* Colisiones antes de evaluar fuerzas (dos objetos en la misma posición darían una fuerza infinita) */
+        collision_pass(num_objects, objects, list, schedule, options);
+        alive = 0;
+        long ending = 0;
+        for (int i = 0; i < num_objects; i++)
+        {
+            alive += objects.active[i];
+            ending += objects.active[i]==true && next % (1L << (options->block_levels - level[i])) == 0;
+        }
+
+        /* Fuerzas y medio impulso de cierre solo de los objetos que terminan su paso. Si las colisiones han
+           eliminado a todos ellos no se preparan las fuerzas (listas de celdas o FFT de PM) */
+        if (ending == 0)
+        {
+            continue;
+        }
+        prepare_forces(num_objects, objects, field, size_enclosure, options);
+        parallel_bodies(options->backend, options->pool, num_objects, 64, parallel_forces(options), [&](int i) {
+            long step = 1L << (options->block_levels - level[i]);
+            if(objects.active[i]==true && next % step == 0){
+                forces[i].x = 0;
+                forces[i].y = 0;
+                forces[i].z = 0;
+                calc_force(num_objects, i, objects, field, options, &forces[i]);
+                vector_acceleration(objects, i, &forces[i], &acceleration[i]);
+                vector_speed(&objects, i, &acceleration[i], dt_min * step / 2);
+
+                // Nuevo nivel: se puede reducir el paso siempre, aumentarlo solo si el subpaso está sincronizado con el nuevo paso
+                int new_level = block_level(&acceleration[i], time_step, options);
+                while (new_level < level[i] && next % (1L << (options->block_levels - new_level)) != 0)
+                {
+                    new_level++;
+                }
+                level[i] = new_level;
+            }
+        });
+        evaluations += ending * (alive - 1);
+    }
+    return evaluations;
+}
+
+/* SIMULATION */
+/* Opciones por defecto */
+inline sim_options default_options()
+{
+    sim_options options;
+    options.integrator = EULER;
+    options.collision = ALL_PAIRS;
+    options.force = DIRECT;
+    options.cutoff = 1000.0;
+    options.softening = 0.0;
+    options.pm_grid = 64;
+    options.skin = 10.0;
+    options.morton = 0;
+    options.energy = false;
+    options.monitor = 0;
+    options.threads = 0;
+    options.tile = 0;
+    options.autotune = false;
+    options.replan = false;
+    options.output_every = 0;
+    options.output_queue = 4;
+    options.compress = 0.0;
+    options.backend = OPENMP;
+    options.pool = NULL;
+    options.reproducible = false;
+    options.rsqrt = 0;
+    options.block_levels = 6;
+    options.block_eta = 1.0;
+    return options;
+}
+
+/* Lectura de los argumentos opcionales (--nombre=valor) de los binarios, desde argv[first] */
+inline bool parse_options(int argc, char const *argv[], int first, sim_options *options)
+{
+    *options = default_options();
+    for (int arg = first; arg < argc; arg++)
+    {
+        std::string option = argv[arg];
+        std::string value = option.substr(option.find('=') + 1);
+        if (option == "--integrator=euler")
+        {
+            options->integrator = EULER;
+        }
+        else if (option == "--integrator=leapfrog")
+        {
+            // Con leapfrog (y por bloques) se informa siempre de la deriva de energía
+            options->integrator = LEAPFROG;
+            options->energy = true;
+        }
+        else if (option == "--integrator=block")
+        {
+            options->integrator = BLOCK;
+            options->energy = true;
+        }
+        else if (option.rfind("--block-levels=", 0) == 0 && atoi(value.c_str()) >= 0 && atoi(value.c_str()) <= 20 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->block_levels = atoi(value.c_str());
+        }
+        else if (option.rfind("--block-eta=", 0) == 0 && atof(value.c_str()) > 0.0)
+        {
+            options->block_eta = atof(value.c_str());
+        }
+        else if (option == "--collision=all")
+        {
+            options->collision = ALL_PAIRS;
+        }
+        else if (option == "--collision=verlet")
+        {
+            options->collision = VERLET;
+        }
+        else if (option.rfind("--skin=", 0) == 0 && atof(value.c_str()) > 0.0)
+        {
+            options->skin = atof(value.c_str());
+        }
+        else if (option.rfind("--morton=", 0) == 0 && atoi(value.c_str()) >= 0 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->morton = atoi(value.c_str());
+        }
+        else if (option == "--force=direct")
+        {
+            options->force = DIRECT;
+        }
+        else if (option == "--force=cutoff")
+        {
+            options->force = CUTOFF;
+        }
+        else if (option == "--force=pm")
+        {
+            options->force = PM;
+        }
+        else if (option.rfind("--pm-grid=", 0) == 0 && atoi(value.c_str()) >= 2 && atoi(value.c_str()) <= 1024 && (atoi(value.c_str()) & (atoi(value.c_str()) - 1)) == 0 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->pm_grid = atoi(value.c_str());
+        }
+        else if (option.rfind("--cutoff=", 0) == 0 && atof(value.c_str()) > 0.0)
+        {
+            options->cutoff = atof(value.c_str());
+        }
+        else if (option.rfind("--softening=", 0) == 0 && atof(value.c_str()) >= 0.0 && !value.empty())
+        {
+            options->softening = atof(value.c_str());
+        }
+        else if (option == "--energy")
+        {
+            options->energy = true;
+        }
+        else if (option.rfind("--threads=", 0) == 0 && atoi(value.c_str()) > 0 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->threads = atoi(value.c_str());
+        }
+        else if (option.rfind("--tile=", 0) == 0 && atoi(value.c_str()) >= 0 && atof(value.c_str()) == atoi(value.c_str()) && !value.empty())
+        {
+            options->tile = atoi(value.c_str());
+        }
+        else if (option == "--autotune")
+        {
+            options->autotune = true;
+        }
+        else if (option == "--replan")
+        {
+            options->replan = true;
+        }
+        else if (option == "--reproducible")
+        {
+            options->reproducible = true;
+        }
+        else if (option == "--rsqrt=1" || option == "--rsqrt=2")
+        {
+            options->rsqrt = atoi(value.c_str());
+        }
+        else if (option == "--backend=openmp")
+        {
+            options->backend = OPENMP;
+        }
+        else if (option == "--backend=std")
+        {
+            options->backend = STD_PAR;
+        }
+        else if (option == "--backend=pool")
+        {
+            options->backend = TASK_POOL;
+        }
+        else if (option.rfind("--output-every=", 0) == 0 && atoi(value.c_str()) >= 0 && atof(value.c_str()) == atoi(value.c_str()) && !value.empty())
+        {
+            options->output_every = atoi(value.c_str());
+        }
+        else if (option.rfind("--output-queue=", 0) == 0 && atoi(value.c_str()) > 0 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->output_queue = atoi(value.c_str());
+        }
+        else if (option.rfind("--compress=", 0) == 0 && atof(value.c_str()) > 0.0 && atof(value.c_str()) < 1.0)
+        {
+            options->compress = atof(value.c_str());
+        }
+        else if (option.rfind("--monitor=", 0) == 0 && atoi(value.c_str()) > 0 && atof(value.c_str()) == atoi(value.c_str()))
+        {
+            options->monitor = atoi(value.c_str());
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Creación de los objetos con coordenadas y masas pseudoaleatorias */
+inline Simulation::Simulation(int num_objects, int random_seed, double size_enclosure, double time_step, sim_options options)
+    : num_objects(num_objects), total_objects(num_objects), size_enclosure(size_enclosure), time_step(time_step), options(options)
+{
+    /* Arenas: columnas, aceleraciones y niveles persistentes; temporales de Euler y de la reordenación Morton */
+    size_t bodies_bytes = 7 * arena_round(sizeof(double)*num_objects) + arena_round(sizeof(bool)*num_objects) + 2 * arena_round(sizeof(int)*num_objects)
+                          + 2 * arena_round(sizeof(vector_elem)*num_objects);
+    size_t scratch_bytes = 2 * arena_round(sizeof(uint64_t)*num_objects) + 2 * arena_round(sizeof(int)*num_objects) + 2 * arena_round(sizeof(vector_elem)*num_objects);
+    // Sin las columnas no se puede seguir (el constructor no devuelve errores)
+    if (!arena_init(&bodies, bodies_bytes) || !arena_init(&scratch, scratch_bytes))
+    {
+        fprintf(stderr, "No se pueden reservar las arenas de %d objetos (%zu + %zu bytes)\n", num_objects, bodies_bytes, scratch_bytes);
+        abort();
+    }
+
+    /* SOA - Structure of Arrays */
+    objects.mass = arena_array<double>(&bodies, num_objects);
+    objects.pos_x  = arena_array<double>(&bodies, num_objects);
+    objects.pos_y  = arena_array<double>(&bodies, num_objects);
+    objects.pos_z  = arena_array<double>(&bodies, num_objects);
+    objects.speed_x  = arena_array<double>(&bodies, num_objects);
+    objects.speed_y = arena_array<double>(&bodies, num_objects);
+    objects.speed_z = arena_array<double>(&bodies, num_objects);
+    objects.active = arena_array<bool>(&bodies, num_objects);
+    objects.id = arena_array<int>(&bodies, num_objects);
+
+    /* Coordenadas y masas pseudoaleatorias */
+    std::mt19937_64 gen(random_seed);
+    std::uniform_real_distribution<double> position_dist(0.0, std::nextafter(size_enclosure, std::numeric_limits<double>::max()));
+    std::normal_distribution<double> mass_dist(M, SDM);
+
+    /* Creación de objetos */
+    for (int i = 0; i < num_objects; i++)
+    {
+        objects.pos_x[i] = position_dist(gen); // Posicion x, y, z
+        objects.pos_y[i] = position_dist(gen);
+        objects.pos_z[i] = position_dist(gen);
+        objects.mass[i] = mass_dist(gen); // Masa
+        objects.speed_x[i] = 0; // Velocidad inicial nula
+        objects.speed_y[i] = 0;
+        objects.speed_z[i] = 0;
+        objects.active[i] = true; // Active
+        objects.id[i] = i; // Identificador
+    }
+}
+
+inline Simulation::~Simulation()
+{
+    arena_free(&bodies);
+    arena_free(&scratch);
+    free(list.start);
+    free(list.neighbours);
+    free(list.ref_x);
+    free(list.ref_y);
+    free(list.ref_z);
+    free(schedule.ref_x);
+    free(schedule.ref_y);
+    free(schedule.ref_z);
+    free(field.cells.cell_start);
+    free(field.cells.cell_objects);
+    free(field.cells.object_cell);
+    free(field.cells.histogram);
+    free(field.pm.density);
+    free(field.pm.green);
+    free(field.pm.accel_x);
+    free(field.pm.accel_y);
+    free(field.pm.accel_z);
+    if (own_pool != NULL)
+    {
+        thread_pool_free(own_pool);
+        delete own_pool;
+    }
+}
+
+/* Preparación antes de la primera iteración: colisiones iniciales, aceleraciones y niveles iniciales y energía inicial */
+inline void Simulation::start()
+{
+    double potential = NAN;
+
+    /* Pool de tareas propio (con options.threads hilos o los de OpenMP) si no se ha dado uno */
+    if (options.backend == TASK_POOL && options.pool == NULL)
+    {
+        own_pool = new thread_pool;
+        thread_pool_init(own_pool, options.threads > 0 ? options.threads : omp_get_max_threads());
+        own_task_pool = make_task_pool(own_pool);
+        options.pool = &own_task_pool;
+    }
+    /* Comprobar colisiones entre objetos previas a las iteraciones */
+    check_collisions(num_objects, objects, &options);
+
+    /* Leapfrog: aceleraciones iniciales, que se reutilizan en el primer medio impulso */
+    if (options.integrator == LEAPFROG || options.integrator == BLOCK)
+    {
+        lf_forces = arena_array<vector_elem>(&bodies, num_objects);
+        lf_acceleration = arena_array<vector_elem>(&bodies, num_objects);
+        calc_accelerations(num_objects, objects, &field, size_enclosure, &options, lf_forces, lf_acceleration, options.monitor > 0 ? &potential : NULL);
+    }
+
+    /* Pasos por bloques: nivel inicial de cada objeto según su aceleración */
+    if (options.integrator == BLOCK)
+    {
+        level = arena_array<int>(&bodies, num_objects);
+        for (int i = 0; i < num_objects; i++)
+        {
+            level[i] = block_level(&lf_acceleration[i], time_step, &options);
+        }
+    }
+
+    /* Energía total inicial para medir la deriva */
+    if (options.energy)
+    {
+        initial_energy = total_energy(num_objects, objects, &options);
+    }
+
+    /* Monitor: muestra del estado inicial (con Euler se toma en la primera evaluación de fuerzas) */
+    if (options.monitor > 0 && options.integrator != EULER)
+    {
+        record(0, potential);
+    }
+    started = true;
+}
+
+/* Iteraciones */
+inline void Simulation::step(int iterations)
+{
+    double step_start = omp_get_wtime();
+    // Los hilos del plan solo valen dentro de step(): al salir se deja el número de la aplicación
+    int previous_threads = omp_get_max_threads();
+    if (options.threads > 0)
+    {
+        omp_set_num_threads(options.threads);
+    }
+    if (!started)
+    {
+        start();
+    }
+
+    for (int n = 0; n < iterations; n++, iterations_done++)
+    {
+        int iteration = iterations_done;
+        /* Con reproducible los eliminados se descartan al empezar cada iteración: las sumas ven siempre los mismos
+           índices, se repartan como se repartan las iteraciones entre llamadas a step() (--output-every) */
+        if (options.reproducible)
+        {
+            compact();
+        }
+        if (options.replan)
+        {
+            replan(iteration);
+        }
+        arena_reset(&scratch);
+        /* Reordenación periódica por código Morton (agrupa en memoria los objetos cercanos y descarta los eliminados) */
+        if (options.morton > 0 && iteration % options.morton == 0)
+        {
+            num_objects = morton_reorder(num_objects, objects, lf_acceleration, level, size_enclosure, &scratch, &radix_histogram);
+            list.valid = false;
+            schedule.valid = false;
+        }
+
+        if (options.integrator == BLOCK)
+        {
+            /* Subpasos del bloque (incluyen las colisiones); al final todos los objetos están sincronizados */
+            block_evaluations += block_step(num_objects, objects, level, lf_forces, lf_acceleration, &list, &schedule, &field, time_step, size_enclosure, &options, &global_evaluations);
+            if (options.monitor > 0)
+            {
+                record(iteration + 1, NAN);
+            }
+            continue;
+        }
+
+        if (options.integrator == LEAPFROG)
+        {
+            /* Medio impulso (kick) con la aceleración del paso anterior, avance de posiciones (drift) y bordes */
+            parallel_bodies(options.backend, options.pool, num_objects, 1024, true, [&](int i) {
+                if(objects.active[i]==true){
+                    integrate_body(objects, i, &lf_acceleration[i], time_step / 2, time_step, size_enclosure);
+                }
+            });
+            collision_pass(num_objects, objects, &list, &schedule, &options);
+            /* Única evaluación de fuerzas del paso (con el potencial si toca muestrearlo) y segundo medio impulso */
+            bool sampled = potential_due(iteration + 1);
+            double potential = NAN;
+            double force_start = omp_get_wtime();
+            calc_forces(num_objects, objects, &field, size_enclosure, &options, lf_forces, sampled ? &potential : NULL);
+            force_time[sampled] += omp_get_wtime() - force_start;
+            force_passes[sampled]++;
+            /* Aceleración y segundo medio impulso en la misma pasada */
+            parallel_bodies(options.backend, options.pool, num_objects, 1024, true, [&](int i) {
+                if(objects.active[i]==true){
+                    vector_acceleration(objects, i, &lf_forces[i], &lf_acceleration[i]);
+                    vector_speed(&objects, i, &lf_acceleration[i], time_step / 2);
+                }
+            });
+            if (options.monitor > 0)
+            {
+                record(iteration + 1, potential);
+            }
+            continue;
+        }
+
+        struct vector_elem *forces = arena_array<vector_elem>(&scratch, num_objects);
+        /* Bucle para obtener nuevas propiedades de los objetos en la iteración (fuerzas)*/
+        bool sampled = potential_due(iteration);
+        double potential = 0;
+        double force_start = omp_get_wtime();
+        calc_forces(num_objects, objects, &field, size_enclosure, &options, forces, sampled ? &potential : NULL);
+        force_time[sampled] += omp_get_wtime() - force_start;
+        force_passes[sampled]++;
+        /* Monitor: estado al empezar la iteración (velocidades aún sin actualizar) */
+        if (options.monitor > 0)
+        {
+            record(iteration, sampled ? potential : NAN);
+        }
+        /* Una sola pasada por objeto: aceleración, velocidad, posición y bordes (integrate_body) */
+        parallel_bodies(options.backend, options.pool, num_objects, 1024, true, [&](int i) {
+            if(objects.active[i]==true){
+                // Solo entrarán en el condicional objetos que no se han eliminado
+                vector_elem acceleration;
+                vector_acceleration(objects, i, &forces[i], &acceleration);
+                integrate_body(objects, i, &acceleration, time_step, time_step, size_enclosure);
+            }
+        });
+        /* Comprobar colisiones entre objetos */
+        collision_pass(num_objects, objects, &list, &schedule, &options);
+    }
+
+    /* Las vistas solo muestran objetos activos */
+    compact();
+    omp_set_num_threads(previous_threads);
+    step_time += omp_get_wtime() - step_start;
+}
+
+/* Muestra del monitor. Sin potential de la evaluación de fuerzas (pasos por bloques, que solo evalúan parte de
+   los objetos en cada subpaso) se calcula aparte con total_energy cuando toca */
+inline void Simulation::record(int iteration, double potential)
+{
+    double begin = omp_get_wtime();
+    monitor_sample sample;
+    sample.iteration = iteration;
+    conserved_quantities(num_objects, objects, &sample, options.reproducible);
+    sample.potential = potential;
+    if (std::isnan(potential) && options.integrator == BLOCK && potential_due(iteration))
+    {
+        sample.potential = total_energy(num_objects, objects, &options) - sample.kinetic;
+    }
+    samples.push_back(sample);
+    monitor_time += omp_get_wtime() - begin;
+}
+
+/* Fracción del tiempo de step() dedicada al monitor: las reducciones medidas más el sobrecoste estimado del
+   potencial en las evaluaciones de fuerzas (diferencia de tiempo medio entre evaluaciones con y sin potencial) */
+inline double Simulation::monitor_overhead() const
+{
+    double fused = 0;
+    if (force_passes[0] > 0 && force_passes[1] > 0)
+    {
+        fused = std::max(0.0, force_time[1] / force_passes[1] - force_time[0] / force_passes[0]) * force_passes[1];
+    }
+    return step_time > 0 ? (monitor_time + fused) / step_time : 0;
+}
+
+/* Cambia el plan de ejecución (se aplica desde el siguiente step()) */
+inline void Simulation::set_plan(const execution_plan &plan)
+{
+    if (plan.collision != options.collision)
+    {
+        list.valid = false;
+    }
+    options.threads = plan.threads;
+    options.tile = plan.tile;
+    options.collision = plan.collision;
+    plan_range = 1;
+    while (plan_range * 2 <= num_objects)
+    {
+        plan_range *= 2;
+    }
+}
+
+/* Replanificación: cuando los objetos activos bajan de la potencia de dos del plan actual (las colisiones los
+   fusionan) se descartan los eliminados y se vuelve a elegir el plan con autotune para el nuevo rango.
+   Solo se registran los cambios. Ni compact() ni el plan cambian los resultados. Los hilos del nuevo plan se
+   aplican al resto de step(), que al terminar deja los de la aplicación */
+inline void Simulation::replan(int iteration)
+{
+    int alive = 0;
+    for (int i = 0; i < num_objects; i++)
+    {
+        alive += objects.active[i];
+    }
+    if (plan_range > 0 && alive >= plan_range)
+    {
+        return;
+    }
+    compact();
+    execution_plan previous = plan();
+    bool cached;
+    double seconds;
+    execution_plan plan = autotune(this, AUTOTUNE_FILE, &cached, &seconds);
+    set_plan(plan);
+    if (plan.threads != previous.threads || plan.tile != previous.tile || plan.collision != previous.collision)
+    {
+        plan_log.push_back({iteration, num_objects, plan, cached, seconds});
+    }
+    omp_set_num_threads(plan.threads);
+}
+
+/* Tiempo mínimo de una evaluación de fuerzas con el plan sobre los objetos actuales (no cambia el estado) */
+inline double Simulation::benchmark_forces(const execution_plan &plan, int repetitions)
+{
+    if (!started)
+    {
+        start();
+    }
+    int previous_threads = omp_get_max_threads();
+    omp_set_num_threads(plan.threads);
+    sim_options candidate = options;
+    candidate.tile = plan.tile;
+    arena_reset(&scratch);
+    vector_elem *forces = arena_array<vector_elem>(&scratch, num_objects);
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < repetitions; r++)
+    {
+        double begin = omp_get_wtime();
+        calc_forces(num_objects, objects, &field, size_enclosure, &candidate, forces);
+        best = std::min(best, omp_get_wtime() - begin);
+    }
+    omp_set_num_threads(previous_threads);
+    return best;
+}
+
+/* Tiempo medio de una pasada de colisiones con el plan sobre los objetos actuales. Las colisiones iniciales ya
+   se han fusionado, así que no cambia el estado. Con VERLET se usa una lista aparte y la media incluye su
+   construcción (una reconstrucción cada repetitions pasadas) */
+inline double Simulation::benchmark_collisions(const execution_plan &plan, int repetitions)
+{
+    if (!started)
+    {
+        start();
+    }
+    int previous_threads = omp_get_max_threads();
+    omp_set_num_threads(plan.threads);
+    sim_options candidate = options;
+    candidate.collision = plan.collision;
+    neighbour_list candidate_list = {};
+    double begin = omp_get_wtime();
+    for (int r = 0; r < repetitions; r++)
+    {
+        // Sin planificación, para medir siempre la pasada completa
+        collision_schedule candidate_schedule = {};
+        collision_pass(num_objects, objects, &candidate_list, &candidate_schedule, &candidate);
+        free(candidate_schedule.ref_x);
+        free(candidate_schedule.ref_y);
+        free(candidate_schedule.ref_z);
+    }
+    double elapsed = (omp_get_wtime() - begin) / repetitions;
+    free(candidate_list.start);
+    free(candidate_list.neighbours);
+    free(candidate_list.ref_x);
+    free(candidate_list.ref_y);
+    free(candidate_list.ref_z);
+    omp_set_num_threads(previous_threads);
+    return elapsed;
+}
+
+/* AUTOTUNE */
+/* Elige el plan de ejecución más rápido para los objetos actuales de simulation. Los hilos (potencias de dos hasta
+   los procesadores disponibles), el bloque de la suma directa y la comprobación de colisiones se miden con unas
+   pocas evaluaciones de cada núcleo. La decisión se guarda en cache_path por máquina, tipo de fuerza y rango de
+   num_objects [2^k, 2^(k+1)); si ya está, se reutiliza sin medir (cached). seconds es el tiempo de la búsqueda */
+inline execution_plan autotune(Simulation *simulation, const char *cache_path, bool *cached, double *seconds)
+{
+    double begin = omp_get_wtime();
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    int range = 1;
+    while (range * 2 <= simulation->count())
+    {
+        range *= 2;
+    }
+    int force = simulation->get_options().force;
+
+    /* Decisión guardada: <host> <rango> <fuerza> <hilos> <bloque> <colisiones> */
+    std::ifstream file_cache(cache_path);
+    std::string line;
+    while (std::getline(file_cache, line))
+    {
+        std::istringstream fields(line);
+        std::string cache_host;
+        int cache_range, cache_force, threads, tile, collision;
+        if (fields >> cache_host >> cache_range >> cache_force >> threads >> tile >> collision &&
+            cache_host == host && cache_range == range && cache_force == force)
+        {
+            *cached = true;
+            *seconds = omp_get_wtime() - begin;
+            return {threads, tile, collision == VERLET ? VERLET : ALL_PAIRS};
+        }
+    }
+    file_cache.close();
+
+    /* Candidatos */
+    std::vector<int> threads;
+    for (int t = 1; t < omp_get_num_procs(); t *= 2)
+    {
+        threads.push_back(t);
+    }
+    threads.push_back(omp_get_num_procs());
+    std::vector<int> tiles = {0};
+    if (force == DIRECT)
+    {
+        for (int tile : {64, 256, 1024})
+        {
+            if (tile < simulation->count())
+            {
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    /* Para cada número de hilos, el mejor bloque y la mejor comprobación de colisiones (núcleos independientes).
+       El bucle directo sin bloques es serie, así que solo se mide una vez */
+    const int repetitions = 2;
+    double untiled = simulation->benchmark_forces({1, 0, ALL_PAIRS}, repetitions);
+    execution_plan best = {1, 0, ALL_PAIRS};
+    double best_time = std::numeric_limits<double>::max();
+    for (int t : threads)
+    {
+        execution_plan plan = {t, 0, ALL_PAIRS};
+        double force_time = force == DIRECT ? untiled : simulation->benchmark_forces(plan, repetitions);
+        for (int tile : tiles)
+        {
+            if (tile > 0)
+            {
+                double time = simulation->benchmark_forces({t, tile, ALL_PAIRS}, repetitions);
+                if (time < force_time)
+                {
+                    force_time = time;
+                    plan.tile = tile;
+                }
+            }
+        }
+        double collision_time = simulation->benchmark_collisions(plan, repetitions);
+        double verlet_time = simulation->benchmark_collisions({t, plan.tile, VERLET}, repetitions);
+        if (verlet_time < collision_time)
+        {
+            collision_time = verlet_time;
+            plan.collision = VERLET;
+        }
+        if (force_time + collision_time < best_time)
+        {
+            best_time = force_time + collision_time;
+            best = plan;
+        }
+    }
+
+    /* Se añade al fichero de decisiones */
+    std::ofstream file_output(cache_path, std::ios::app);
+    file_output << host << " " << range << " " << force << " " << best.threads << " " << best.tile << " " << (int)best.collision << "\n";
+    *cached = false;
+    *seconds = omp_get_wtime() - begin;
+    return best;
+}
+
+/* Descarta los objetos eliminados conservando el orden de los activos (las sumas de fuerzas no cambian) */
+inline void Simulation::compact()
+{
+    int k = 0;
+    for (int i = 0; i < num_objects; i++)
+    {
+        if(objects.active[i]==true){
+            if (k != i)
+            {
+                objects.pos_x[k] = objects.pos_x[i];
+                objects.pos_y[k] = objects.pos_y[i];
+                objects.pos_z[k] = objects.pos_z[i];
+                objects.speed_x[k] = objects.speed_x[i];
+                objects.speed_y[k] = objects.speed_y[i];
+                objects.speed_z[k] = objects.speed_z[i];
+                objects.mass[k] = objects.mass[i];
+                objects.active[k] = true;
+                objects.id[k] = objects.id[i];
+                if (lf_acceleration != NULL)
+                {
+                    lf_acceleration[k] = lf_acceleration[i];
+                }
+                if (level != NULL)
+                {
+                    level[k] = level[i];
+                }
+            }
+            k++;
+        }
+    }
+    if (k != num_objects)
+    {
+        // Los índices de las listas de vecinos y de la planificación de colisiones ya no son válidos
+        num_objects = k;
+        list.valid = false;
+        schedule.valid = false;
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* Librerias */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include "codec.hpp"
+
+using namespace std;
+
+/* DECLARACIÓN PREVIA DE FUNCIONES */
+bool read_file(const string &path, string *bytes);
+string text_path(const string &path);
+
+/* MAIN */
+/* Decodifica las instantáneas comprimidas de sim-psoa --compress (snapshots/snapshot_<iteration>.snap) y
+   escribe cada una junto a ella en el formato de final_config.txt (.txt). Las instantáneas se decodifican en
+   el orden de los argumentos, que debe ser el de la simulación desde una instantánea completa */
+int main(int argc, char const *argv[])
+{
+    /* Comprobación inicial argumentos */
+    if (argc < 2)
+    {
+        cerr << "Número de argumentos incorrecto\n";
+        cerr << "Uso: ./snapshot-decode <snapshot.snap>...\n";
+        return -1;
+    }
+
+    codec_state state;
+    codec_frame frame;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        string bytes;
+        if (!read_file(argv[arg], &bytes))
+        {
+            cerr << "No se puede leer " << argv[arg] << "\n";
+            return -3;
+        }
+        if (!codec_decode(bytes, &state, &frame))
+        {
+            cerr << "Instantánea no válida o sin la anterior: " << argv[arg] << "\n";
+            return -2;
+        }
+
+        ostringstream output;
+        output << fixed << setprecision(3) << frame.size_enclosure << " " << frame.time_step << " " << frame.created << "\n";
+        for (size_t k = 0; k < frame.id.size(); k++)
+        {
+            output << frame.column[0][k] << " " << frame.column[1][k] << " " << frame.column[2][k] << " " << frame.column[3][k] << " " << frame.column[4][k] << " " << frame.column[5][k] << " " << frame.column[6][k] << "\n";
+        }
+        ofstream file_output;
+        file_output.open(text_path(argv[arg]));
+        file_output << output.str();
+        file_output.close();
+        if (!file_output)
+        {
+            cerr << "No se puede escribir " << text_path(argv[arg]) << "\n";
+            return -3;
+        }
+        cout << argv[arg] << ": " << frame.id.size() << " objects, " << bytes.size() << " bytes -> " << text_path(argv[arg]) << "\n";
+    }
+}
+
+/* FUNCIONES */
+/* Lee un fichero completo */
+bool read_file(const string &path, string *bytes)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    ostringstream content;
+    content << file.rdbuf();
+    *bytes = content.str();
+    return true;
+}
+
+/* Fichero de texto de una instantánea: la extensión .snap se cambia por .txt */
+string text_path(const string &path)
+{
+    size_t dot = path.rfind(".snap");
+    return (dot != string::npos && dot + 5 == path.size() ? path.substr(0, dot) : path) + ".txt";
+}